@@ -330,6 +330,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/grouplist.h \
         src/friendlist.h \
         src/persistence/smileypack.h \
+        src/persistence/emoticonmatcher.h \
         src/widget/emoticonswidget.h \
         src/widget/style.h \
         src/widget/tool/croppinglabel.h \
@@ -347,6 +348,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/chatlog/content/spinner.h \
         src/chatlog/content/filetransferwidget.h \
         src/chatlog/chatmessage.h \
+        src/chatlog/messageformatter.h \
         src/chatlog/content/image.h \
         src/chatlog/customtextdocument.h \
         src/widget/form/settings/aboutform.h \
@@ -354,6 +356,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/chatlog/content/notificationicon.h \
         src/chatlog/content/timestamp.h \
         src/chatlog/documentcache.h \
+        src/chatlog/textmeasurer.h \
         src/chatlog/pixmapcache.h \
         src/persistence/offlinemsgengine.h \
         src/widget/form/addfriendform.h \
@@ -418,6 +421,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/group.cpp \
         src/grouplist.cpp \
         src/persistence/smileypack.cpp \
+        src/persistence/emoticonmatcher.cpp \
         src/widget/emoticonswidget.cpp \
         src/widget/style.cpp \
         src/widget/tool/croppinglabel.cpp \
@@ -435,6 +439,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/chatlog/content/spinner.cpp \
         src/chatlog/content/filetransferwidget.cpp \
         src/chatlog/chatmessage.cpp \
+        src/chatlog/messageformatter.cpp \
         src/chatlog/content/image.cpp \
         src/chatlog/customtextdocument.cpp\
         src/widget/form/settings/aboutform.cpp \
@@ -442,6 +447,7 @@ contains(ENABLE_SYSTRAY_GTK_BACKEND, NO) {
         src/chatlog/content/notificationicon.cpp \
         src/chatlog/content/timestamp.cpp \
         src/chatlog/documentcache.cpp \
+        src/chatlog/textmeasurer.cpp \
         src/chatlog/pixmapcache.cpp \
         src/persistence/offlinemsgengine.cpp \
         src/widget/qrwidget.cpp \
@@ -480,6 +486,8 @@ macx {
 
 SOURCES += \
     src/audio/audio.cpp \
+    src/audio/audiojitterbuffer.cpp \
+    src/audio/audiomixer.cpp \
     src/persistence/historykeeper.cpp \
     src/main.cpp \
     src/nexus.cpp \
@@ -490,12 +498,18 @@ SOURCES += \
     src/persistence/db/plaindb.cpp \
     src/persistence/db/encrypteddb.cpp \
     src/video/videoframe.cpp \
+    src/video/framebufferpool.cpp \
+    src/video/scalercache.cpp \
     src/widget/gui.cpp \
     src/net/toxme.cpp \
+    src/net/toxresolver.cpp \
     src/core/core.cpp \
     src/core/coreav.cpp \
+    src/core/videoratecontroller.cpp \
     src/core/coreencryption.cpp \
     src/core/corefile.cpp \
+    src/core/filereadahead.cpp \
+    src/core/filewritebehind.cpp \
     src/core/corestructs.cpp \
     src/persistence/profilelocker.cpp \
     src/net/avatarbroadcaster.cpp \
@@ -510,6 +524,7 @@ SOURCES += \
     src/video/corevideosource.cpp \
     src/core/toxid.cpp \
     src/persistence/profile.cpp \
+    src/persistence/passkeycache.cpp \
     src/widget/translator.cpp \
     src/persistence/settingsserializer.cpp \
     src/widget/notificationscrollarea.cpp \
@@ -534,10 +549,15 @@ SOURCES += \
 
 HEADERS += \
     src/audio/audio.h \
+    src/audio/audiojitterbuffer.h \
+    src/audio/audiomixer.h \
     src/core/core.h \
     src/core/coreav.h \
+    src/core/videoratecontroller.h \
     src/core/coredefines.h \
     src/core/corefile.h \
+    src/core/filereadahead.h \
+    src/core/filewritebehind.h \
     src/core/corestructs.h \
     src/persistence/historykeeper.h \
     src/nexus.h \
@@ -548,9 +568,12 @@ HEADERS += \
     src/persistence/db/plaindb.h \
     src/persistence/db/encrypteddb.h \
     src/video/videoframe.h \
+    src/video/framebufferpool.h \
+    src/video/scalercache.h \
     src/video/videosource.h \
     src/widget/gui.h \
     src/net/toxme.h \
+    src/net/toxresolver.h \
     src/persistence/profilelocker.h \
     src/net/avatarbroadcaster.h \
     src/widget/tool/screenshotgrabber.h \
@@ -565,6 +588,7 @@ HEADERS += \
     src/video/videomode.h \
     src/core/toxid.h \
     src/persistence/profile.h \
+    src/persistence/passkeycache.h \
     src/widget/translator.h \
     src/persistence/settingsserializer.h \
     src/widget/notificationscrollarea.h \
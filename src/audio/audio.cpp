@@ -18,8 +18,7 @@
 */
 
 #include "audio.h"
-#include "src/core/core.h"
-#include "src/core/coreav.h"
+#include "audiomixer.h"
 #include "src/persistence/settings.h"
 
 #include <QDebug>
@@ -305,11 +304,8 @@ bool Audio::initOutput(QString outDevDescr)
     alListenerf(AL_GAIN, Settings::getInstance().getOutVolume() * 0.01f);
     checkAlError();
 
-    Core* core = Core::getInstance();
-    if (core) {
-        // reset each call's audio source
-        core->getAv()->invalidateCallSources();
-    }
+    // reset each call's audio source
+    AudioMixer::getInstance().invalidateSources();
 
     outputInitialized = true;
     return true;
@@ -354,20 +350,6 @@ void Audio::playMono16Sound(const QByteArray& data)
     playMono16Timer.start(durationMs + 50);
 }
 
-/**
-@brief May be called from any thread, will always queue a call to playGroupAudio.
-
-The first and last argument are ignored, but allow direct compatibility with toxcore.
-*/
-void Audio::playGroupAudioQueued(void*,int group, int peer, const int16_t* data,
-                        unsigned samples, uint8_t channels, unsigned sample_rate, void* core)
-{
-    QMetaObject::invokeMethod(&Audio::getInstance(), "playGroupAudio", Qt::BlockingQueuedConnection,
-                              Q_ARG(int,group), Q_ARG(int,peer), Q_ARG(const int16_t*,data),
-                              Q_ARG(unsigned,samples), Q_ARG(uint8_t,channels), Q_ARG(unsigned,sample_rate));
-    emit static_cast<Core*>(core)->groupPeerAudioPlaying(group, peer);
-}
-
 void Audio::playAudioBuffer(ALuint alSource, const int16_t *data, int samples, unsigned channels, int sampleRate)
 {
     assert(channels == 1 || channels == 2);
@@ -408,6 +390,22 @@ void Audio::playAudioBuffer(ALuint alSource, const int16_t *data, int samples, u
         alSourcePlay(alSource);
 }
 
+/**
+Returns the number of buffers queued on the source that haven't been played yet
+*/
+int Audio::getPendingBuffers(ALuint alSource)
+{
+    QMutexLocker locker(&audioLock);
+
+    if (!(alOutDev && outputInitialized))
+        return 0;
+
+    ALint processed = 0, queued = 0;
+    alGetSourcei(alSource, AL_BUFFERS_PROCESSED, &processed);
+    alGetSourcei(alSource, AL_BUFFERS_QUEUED, &queued);
+    return queued - processed;
+}
+
 /**
 @internal
 
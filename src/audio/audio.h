@@ -85,9 +85,7 @@ public:
 
     void playAudioBuffer(ALuint alSource, const int16_t *data, int samples,
                          unsigned channels, int sampleRate);
-
-    static void playGroupAudioQueued(void *, int group, int peer, const int16_t* data,
-                                     unsigned samples, uint8_t channels, unsigned sample_rate, void*);
+    int getPendingBuffers(ALuint alSource);
 
 signals:
     void groupAudioPlayed(int group, int peer, unsigned short volume);
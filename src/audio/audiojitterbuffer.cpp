@@ -0,0 +1,121 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audiojitterbuffer.h"
+#include "audio.h"
+
+static_assert(AUDIO_CHANNELS == 2, "The jitter buffer stores stereo frames");
+
+AudioJitterBuffer::AudioJitterBuffer()
+    : ring{new int16_t[capacity * AUDIO_CHANNELS]},
+      writePos{0}, readPos{0}, underruns{0}, overruns{0},
+      playing{false}, emptyFrames{0}
+{
+}
+
+bool AudioJitterBuffer::push(const int16_t* data, unsigned samples, uint8_t channels, unsigned sampleRate)
+{
+    if (!samples || !sampleRate || (channels != 1 && channels != 2))
+        return false;
+
+    const size_t write = writePos.load(std::memory_order_relaxed);
+    const size_t read = readPos.load(std::memory_order_acquire);
+    const size_t count = static_cast<uint64_t>(samples) * AUDIO_SAMPLE_RATE / sampleRate;
+    if (count > capacity - (write - read))
+    {
+        overruns.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Opus always decodes at 48kHz, so the nearest neighbor resampling is only a fallback
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t src = sampleRate == AUDIO_SAMPLE_RATE ? i : static_cast<uint64_t>(i) * sampleRate / AUDIO_SAMPLE_RATE;
+        int16_t* dst = &ring[((write + i) & mask) * AUDIO_CHANNELS];
+        dst[0] = data[src * channels];
+        dst[1] = data[src * channels + channels - 1];
+    }
+
+    writePos.store(write + count, std::memory_order_release);
+    return true;
+}
+
+bool AudioJitterBuffer::mixInto(int32_t* mix)
+{
+    size_t read = readPos.load(std::memory_order_relaxed);
+    size_t available = writePos.load(std::memory_order_acquire) - read;
+
+    if (!playing)
+    {
+        if (available < static_cast<size_t>(prebufferFrames * AUDIO_FRAME_SAMPLE_COUNT))
+        {
+            if (!available)
+                ++emptyFrames;
+            return false;
+        }
+        playing = true;
+    }
+
+    // The sender's clock runs faster than ours, drop the oldest audio to keep the latency bounded
+    if (available > static_cast<size_t>(maxBufferedFrames * AUDIO_FRAME_SAMPLE_COUNT))
+    {
+        const size_t skip = available - prebufferFrames * AUDIO_FRAME_SAMPLE_COUNT;
+        read += skip;
+        available -= skip;
+        overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t count = available;
+    if (available < static_cast<size_t>(AUDIO_FRAME_SAMPLE_COUNT))
+    {
+        // Play what's left, the rest of the frame stays silent
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        playing = false;
+    }
+    else
+    {
+        count = AUDIO_FRAME_SAMPLE_COUNT;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int16_t* src = &ring[((read + i) & mask) * AUDIO_CHANNELS];
+        mix[i * AUDIO_CHANNELS] += src[0];
+        mix[i * AUDIO_CHANNELS + 1] += src[1];
+    }
+
+    readPos.store(read + count, std::memory_order_release);
+    emptyFrames = count ? 0 : emptyFrames + 1;
+    return count;
+}
+
+bool AudioJitterBuffer::isIdle() const
+{
+    return emptyFrames >= idleFrames;
+}
+
+uint64_t AudioJitterBuffer::getUnderruns() const
+{
+    return underruns.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioJitterBuffer::getOverruns() const
+{
+    return overruns.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOJITTERBUFFER_H
+#define AUDIOJITTERBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+/// Single producer, single consumer ring of 48kHz stereo audio for one call or group peer
+/// The producer is a toxcore callback and the consumer is the AudioMixer, neither ever locks or waits.
+/// Playback starts once a few frames are buffered, so that network jitter doesn't turn into gaps.
+class AudioJitterBuffer
+{
+public:
+    AudioJitterBuffer();
+    AudioJitterBuffer(const AudioJitterBuffer&) = delete;
+    AudioJitterBuffer& operator=(const AudioJitterBuffer&) = delete;
+
+    /// Producer side, converts the frame to 48kHz stereo
+    /// Drops the whole frame and counts an overrun if it doesn't fit
+    bool push(const int16_t* data, unsigned samples, uint8_t channels, unsigned sampleRate);
+    /// Consumer side, adds one frame of AUDIO_FRAME_SAMPLE_COUNT stereo samples to mix
+    /// Returns false if nothing was added. Running dry counts an underrun and buffers up again.
+    bool mixInto(int32_t* mix);
+    /// Consumer side, true once the buffer was found empty idleFrames times in a row
+    bool isIdle() const;
+
+    uint64_t getUnderruns() const;
+    uint64_t getOverruns() const;
+
+private:
+    static constexpr size_t capacity = 1 << 14; ///< In stereo samples, about 340ms
+    static constexpr size_t mask = capacity - 1;
+    static constexpr int prebufferFrames = 2; ///< Frames to buffer before playing, trades latency for smoothness
+    static constexpr int maxBufferedFrames = 6; ///< Above this, we're lagging behind the sender and skip ahead
+    static constexpr int idleFrames = 500; ///< A few seconds of silence
+
+    std::unique_ptr<int16_t[]> ring;
+    alignas(64) std::atomic<size_t> writePos; ///< Only written by the producer
+    alignas(64) std::atomic<size_t> readPos; ///< Only written by the consumer
+    std::atomic<uint64_t> underruns, overruns;
+    bool playing; ///< Consumer only
+    int emptyFrames; ///< Consumer only
+};
+
+#endif // AUDIOJITTERBUFFER_H
@@ -0,0 +1,227 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audiomixer.h"
+#include "audiojitterbuffer.h"
+#include "audio.h"
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QPair>
+#include <QDebug>
+#include <algorithm>
+
+AudioMixer& AudioMixer::getInstance()
+{
+    static AudioMixer instance;
+    return instance;
+}
+
+AudioMixer::AudioMixer()
+    : mixerThread{new QThread}, mixTimer{new QTimer{this}},
+      removedUnderruns{0}, removedOverruns{0},
+      sourcesInvalid{false}, mixedFrames{0}, nextStream{1}
+{
+    mixerThread->setObjectName("qTox Audio Mixer");
+    connect(mixerThread, &QThread::finished, mixerThread, &QThread::deleteLater);
+
+    // We mix twice per frame, but only queue frames when OpenAL is running low
+    mixTimer->setTimerType(Qt::PreciseTimer);
+    mixTimer->setInterval(AUDIO_FRAME_DURATION/2);
+    connect(mixTimer, &QTimer::timeout, this, &AudioMixer::mix);
+    connect(mixerThread, &QThread::started, mixTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    moveToThread(mixerThread);
+    mixerThread->start();
+}
+
+AudioMixer::~AudioMixer()
+{
+    mixerThread->exit();
+    mixerThread->wait();
+}
+
+int AudioMixer::addStream()
+{
+    int stream;
+    {
+        QMutexLocker locker(&registryLock);
+        stream = nextStream++;
+        streams.insert(stream, Stream());
+    }
+
+    // Open the output right away, so it's ready when the first frames arrive
+    QMutexLocker locker(&mixLock);
+    sources.insert(stream, 0);
+    subscribe(stream);
+    return stream;
+}
+
+void AudioMixer::removeStream(int stream)
+{
+    if (!stream)
+        return;
+
+    {
+        QMutexLocker locker(&registryLock);
+        auto it = streams.find(stream);
+        if (it != streams.end())
+        {
+            for (const std::shared_ptr<AudioJitterBuffer>& buffer : it->peers)
+            {
+                removedUnderruns += buffer->getUnderruns();
+                removedOverruns += buffer->getOverruns();
+            }
+            streams.erase(it);
+        }
+    }
+
+    QMutexLocker locker(&mixLock);
+    quint32 source = sources.take(stream);
+    Audio::getInstance().unsubscribeOutput(source);
+}
+
+void AudioMixer::pushFrame(int stream, int peer, const int16_t* data, unsigned samples,
+                           uint8_t channels, unsigned sampleRate)
+{
+    std::shared_ptr<AudioJitterBuffer> buffer;
+    {
+        QMutexLocker locker(&registryLock);
+        auto it = streams.find(stream);
+        if (it == streams.end())
+            return;
+
+        std::shared_ptr<AudioJitterBuffer>& peerBuffer = it->peers[peer];
+        if (!peerBuffer)
+            peerBuffer = std::make_shared<AudioJitterBuffer>();
+        buffer = peerBuffer;
+    }
+
+    buffer->push(data, samples, channels, sampleRate);
+}
+
+void AudioMixer::invalidateSources()
+{
+    sourcesInvalid = true;
+}
+
+AudioMixer::Stats AudioMixer::getStats()
+{
+    QMutexLocker locker(&registryLock);
+    Stats stats{mixedFrames, removedUnderruns, removedOverruns, streams.size(), 0};
+    for (const Stream& stream : streams)
+    {
+        stats.peers += stream.peers.size();
+        for (const std::shared_ptr<AudioJitterBuffer>& buffer : stream.peers)
+        {
+            stats.underruns += buffer->getUnderruns();
+            stats.overruns += buffer->getOverruns();
+        }
+    }
+    return stats;
+}
+
+void AudioMixer::subscribe(int stream)
+{
+    quint32& source = sources[stream];
+    Audio::getInstance().subscribeOutput(source);
+
+    // Opening the device destroyed the sources of the other streams, not the one we just made
+    if (sourcesInvalid.exchange(false))
+    {
+        for (auto it = sources.begin(); it != sources.end(); ++it)
+            if (it.key() != stream)
+                *it = 0;
+    }
+}
+
+void AudioMixer::mix()
+{
+    QMutexLocker mixLocker(&mixLock);
+
+    if (sourcesInvalid.exchange(false))
+    {
+        for (quint32& source : sources)
+            source = 0;
+    }
+
+    // Take a snapshot of the peers, so the producers never wait for us to mix
+    QVector<QPair<int, QVector<std::shared_ptr<AudioJitterBuffer>>>> snapshot;
+    {
+        QMutexLocker locker(&registryLock);
+        snapshot.reserve(streams.size());
+        for (auto it = streams.begin(); it != streams.end(); ++it)
+        {
+            QVector<std::shared_ptr<AudioJitterBuffer>> buffers;
+            for (auto peer = it->peers.begin(); peer != it->peers.end();)
+            {
+                // Peers that left a group call stop sending, we forget them once they've been quiet for a while
+                if ((*peer)->isIdle())
+                {
+                    removedUnderruns += (*peer)->getUnderruns();
+                    removedOverruns += (*peer)->getOverruns();
+                    peer = it->peers.erase(peer);
+                    continue;
+                }
+
+                buffers << *peer;
+                ++peer;
+            }
+
+            if (!buffers.isEmpty())
+                snapshot.append({it.key(), buffers});
+        }
+    }
+
+    Audio& audio = Audio::getInstance();
+    int32_t mixed[AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS];
+    int16_t frame[AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS];
+    for (const auto& stream : snapshot)
+    {
+        auto source = sources.find(stream.first);
+        if (source == sources.end())
+            continue;
+
+        if (!*source)
+        {
+            subscribe(stream.first);
+            source = sources.find(stream.first);
+            if (!*source)
+                continue;
+        }
+
+        // Keep OpenAL's queue topped up, this follows the device's clock instead of our timer's
+        while (audio.getPendingBuffers(*source) < maxQueuedFrames)
+        {
+            std::fill(std::begin(mixed), std::end(mixed), 0);
+            bool audible = false;
+            for (const std::shared_ptr<AudioJitterBuffer>& buffer : stream.second)
+                audible |= buffer->mixInto(mixed);
+
+            if (!audible)
+                break;
+
+            for (size_t i = 0; i < AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS; ++i)
+                frame[i] = std::max(-32768, std::min(32767, mixed[i]));
+
+            audio.playAudioBuffer(*source, frame, AUDIO_FRAME_SAMPLE_COUNT, AUDIO_CHANNELS, AUDIO_SAMPLE_RATE);
+            ++mixedFrames;
+        }
+    }
+}
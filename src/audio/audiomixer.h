@@ -0,0 +1,95 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+class QThread;
+class QTimer;
+class AudioJitterBuffer;
+
+/// Mixes the audio of call and group peers into one OpenAL source per call, on its own thread
+/// Peers' frames go through lock-free jitter buffers, so toxcore's threads never wait on the audio output.
+/// The class is thread safe
+class AudioMixer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        uint64_t mixedFrames;
+        uint64_t underruns; ///< Peers that ran dry while playing
+        uint64_t overruns; ///< Frames dropped or skipped because a peer's buffer was too full
+        int streams;
+        int peers;
+    };
+
+public:
+    static AudioMixer& getInstance();
+
+    /// Opens an output stream for a call, returns its ID which is never 0
+    int addStream();
+    /// Closes the output stream, its pending audio is dropped
+    void removeStream(int stream);
+    /// Queues a frame of one peer's audio for the stream, never blocks
+    /// Must only be called from one thread per peer, like toxcore's callbacks
+    void pushFrame(int stream, int peer, const int16_t* data, unsigned samples, uint8_t channels, unsigned sampleRate);
+    /// Our OpenAL sources were destroyed with the output device, new ones will be created
+    void invalidateSources();
+
+    Stats getStats();
+
+private slots:
+    void mix();
+
+private:
+    AudioMixer();
+    ~AudioMixer();
+    /// Creates the stream's source, must be called with the mixLock held
+    void subscribe(int stream);
+
+private:
+    struct Stream
+    {
+        QHash<int, std::shared_ptr<AudioJitterBuffer>> peers;
+    };
+
+    QThread* mixerThread;
+    QTimer* mixTimer;
+    QMutex registryLock; ///< Protects streams and the counters of removed peers, never held while mixing
+    QHash<int, Stream> streams;
+    uint64_t removedUnderruns, removedOverruns;
+    QMutex mixLock; ///< Protects sources, held while mixing
+    QHash<int, quint32> sources; ///< OpenAL source of each stream, 0 until it's created
+    std::atomic_bool sourcesInvalid;
+    std::atomic<uint64_t> mixedFrames;
+    int nextStream;
+
+    static constexpr int maxQueuedFrames = 3; ///< Frames queued in OpenAL ahead of the device, our output latency
+};
+
+#endif // AUDIOMIXER_H
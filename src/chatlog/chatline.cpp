@@ -100,6 +100,11 @@ void ChatLine::addToScene(QGraphicsScene *scene)
         scene->addItem(c);
 }
 
+bool ChatLine::isInScene() const
+{
+    return !content.empty() && content.front()->scene();
+}
+
 void ChatLine::setVisible(bool visible)
 {
     for (ChatLineContent* c : content)
@@ -165,14 +170,8 @@ void ChatLine::replaceContent(int col, ChatLineContent *lineContent)
     }
 }
 
-void ChatLine::layout(qreal w, QPointF scenePos)
+QVector<qreal> ChatLine::getColumnWidths(qreal w) const
 {
-    if (!content.size())
-        return;
-
-    width = w;
-    bbox.setTopLeft(scenePos);
-
     qreal fixedWidth = (content.size()-1) * columnSpacing;
     qreal varWidth = 0.0; // used for normalisation
 
@@ -187,22 +186,39 @@ void ChatLine::layout(qreal w, QPointF scenePos)
     if (varWidth == 0.0)
         varWidth = 1.0;
 
-    qreal leftover = qMax(0.0, width - fixedWidth);
+    qreal leftover = qMax(0.0, w - fixedWidth);
 
+    QVector<qreal> widths;
+    widths.reserve(format.size());
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+        // calculate the effective width of the current column
+        if (format[i].policy == ColumnFormat::FixedSize)
+            widths << format[i].size;
+        else
+            widths << format[i].size / varWidth * leftover;
+    }
+
+    return widths;
+}
+
+void ChatLine::layout(qreal w, QPointF scenePos)
+{
+    if (!content.size())
+        return;
+
+    width = w;
+    bbox.setTopLeft(scenePos);
+
+    QVector<qreal> widths = getColumnWidths(width);
     qreal maxVOffset = 0.0;
     qreal xOffset = 0.0;
     qreal xPos[content.size()];
 
     for (size_t i = 0; i < content.size(); ++i)
     {
-        // calculate the effective width of the current column
-        qreal width;
-        if (format[i].policy == ColumnFormat::FixedSize)
-            width = format[i].size;
-        else
-            width = format[i].size / varWidth * leftover;
-
         // set the width of the current column
+        qreal width = widths[i];
         content[i]->setWidth(width);
 
         // calculate horizontal alignment
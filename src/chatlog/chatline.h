@@ -24,6 +24,7 @@
 #include <vector>
 #include <QPointF>
 #include <QRectF>
+#include <QVector>
 
 class ChatLog;
 class ChatLineContent;
@@ -69,9 +70,11 @@ public:
 
     void replaceContent(int col, ChatLineContent* lineContent);
     void layout(qreal width, QPointF scenePos);
+    QVector<qreal> getColumnWidths(qreal width) const; ///< Widths the columns get when laid out at this width
     void moveBy(qreal deltaY);
     void removeFromScene();
     void addToScene(QGraphicsScene* scene);
+    bool isInScene() const;
     void setVisible(bool visible);
     void selectionCleared();
     void selectionFocusChanged(bool focusIn);
@@ -20,6 +20,8 @@
 #include "chatlog.h"
 #include "chatmessage.h"
 #include "chatlinecontent.h"
+#include "textmeasurer.h"
+#include "content/text.h"
 #include "src/widget/translator.h"
 
 #include <QDebug>
@@ -30,6 +32,7 @@
 #include <QTimer>
 #include <QMouseEvent>
 #include <QShortcut>
+#include <QElapsedTimer>
 
 template<class T>
 T clamp(T x, T min, T max)
@@ -45,7 +48,6 @@ ChatLog::ChatLog(QWidget* parent)
     : QGraphicsView(parent)
 {
     // Create the scene
-    busyScene = new QGraphicsScene(this);
     scene = new QGraphicsScene(this);
     scene->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
     setScene(scene);
@@ -100,6 +102,16 @@ ChatLog::ChatLog(QWidget* parent)
     workerTimer->setInterval(5);
     connect(workerTimer, &QTimer::timeout, this, &ChatLog::onWorkerTimeout);
 
+    // Measures the texts at the new width on the thread pool before the worker starts
+    measureWatcher = new QFutureWatcher<void>(this);
+    connect(measureWatcher, &QFutureWatcher<void>::finished, this, &ChatLog::onMeasureFinished);
+
+    // Waits for the window resizing to settle, each measurement goes over the whole log
+    resizeTimer = new QTimer(this);
+    resizeTimer->setSingleShot(true);
+    resizeTimer->setInterval(100);
+    connect(resizeTimer, &QTimer::timeout, this, &ChatLog::startMeasurement);
+
     // selection
     connect(this, &ChatLog::selectionChanged, this, [this]() {
         copyAction->setEnabled(hasTextToBeCopied());
@@ -116,13 +128,13 @@ ChatLog::~ChatLog()
 {
     Translator::unregister(this);
 
+    if (measureCancelled)
+        measureCancelled->store(1);
+
     // Remove chatlines from scene
-    for (ChatLine::Ptr l : lines)
+    for (ChatLine::Ptr l : sceneLines)
         l->removeFromScene();
 
-    if (busyNotification)
-        busyNotification->removeFromScene();
-
     if (typingNotification)
         typingNotification->removeFromScene();
 }
@@ -360,9 +372,8 @@ void ChatLog::insertChatlineAtBottom(ChatLine::Ptr l)
 
     bool stickToBtm = stickToBottom();
 
-    //insert
+    //insert, checkVisibility adds it to the scene if it's near the viewport
     l->setRow(lines.size());
-    l->addToScene(scene);
     lines.append(l);
 
     //partial refresh
@@ -389,9 +400,6 @@ void ChatLog::insertChatlineOnTop(const QList<ChatLine::Ptr>& newLines)
     if (newLines.isEmpty())
         return;
 
-    QGraphicsScene::ItemIndexMethod oldIndexMeth = scene->itemIndexMethod();
-    scene->setItemIndexMethod(QGraphicsScene::NoIndex);
-
     // alloc space for old and new lines
     QVector<ChatLine::Ptr> combLines;
     combLines.reserve(newLines.size() + lines.size());
@@ -400,7 +408,6 @@ void ChatLog::insertChatlineOnTop(const QList<ChatLine::Ptr>& newLines)
     int i = 0;
     for (ChatLine::Ptr l : newLines)
     {
-        l->addToScene(scene);
         l->visibilityChanged(false);
         l->setRow(i++);
         combLines.push_back(l);
@@ -415,8 +422,6 @@ void ChatLog::insertChatlineOnTop(const QList<ChatLine::Ptr>& newLines)
 
     lines = combLines;
 
-    scene->setItemIndexMethod(oldIndexMeth);
-
     // redo layout
     startResizeWorker();
 }
@@ -437,33 +442,52 @@ void ChatLog::startResizeWorker()
     if (lines.empty())
         return;
 
-    // (re)start the worker
-    if (!workerTimer->isActive())
+    anchorWorker();
+    startMeasurement();
+}
+
+void ChatLog::anchorWorker()
+{
+    // these values must not be reevaluated while the worker is running
+    if (!workerTimer->isActive() && !measureWatcher->isRunning())
     {
-        // these values must not be reevaluated while the worker is running
         workerStb = stickToBottom();
 
         if (!visibleLines.empty())
             workerAnchorLine = visibleLines.first();
     }
+}
 
-    // switch to busy scene displaying the busy notification if there is a lot
-    // of text to be resized
-    int txt = 0;
+void ChatLog::startMeasurement()
+{
+    resizeTimer->stop();
+    workerTimer->stop();
+
+    if (lines.empty())
+        return;
+
+    // Measure every text at its new column width on the thread pool,
+    // so the worker only has to position the lines on the GUI thread.
+    // The stale job is cancelled, what it measured already stays cached
+    if (measureCancelled)
+        measureCancelled->store(1);
+
+    measureCancelled = TextMeasurer::CancelToken::create(0);
+
+    qreal width = useableWidth();
+    QVector<TextMeasurer::Request> requests;
     for (ChatLine::Ptr line : lines)
     {
-        if (txt > 500000)
-            break;
-        for (ChatLineContent* content : line->content)
-            txt += content->getText().size();
+        QVector<qreal> widths = line->getColumnWidths(width);
+        for (int i = 0; i < widths.size(); ++i)
+        {
+            Text* text = dynamic_cast<Text*>(line->getContent(i));
+            if (text)
+                requests << text->getMeasureRequest(widths[i]);
+        }
     }
-    if (txt > 500000)
-        setScene(busyScene);
-
-    workerLastIndex = 0;
-    workerTimer->start();
 
-    verticalScrollBar()->hide();
+    measureWatcher->setFuture(TextMeasurer::measure(requests, measureCancelled));
 }
 
 void ChatLog::mouseDoubleClickEvent(QMouseEvent *ev)
@@ -546,11 +570,12 @@ void ChatLog::clear()
 {
     clearSelection();
 
-    for (ChatLine::Ptr l : lines)
+    for (ChatLine::Ptr l : sceneLines)
         l->removeFromScene();
 
     lines.clear();
     visibleLines.clear();
+    sceneLines.clear();
 
     updateSceneRect();
 }
@@ -564,16 +589,6 @@ void ChatLog::copySelectedText(bool toSelectionBuffer) const
         clipboard->setText(text, toSelectionBuffer ? QClipboard::Selection : QClipboard::Clipboard);
 }
 
-void ChatLog::setBusyNotification(ChatLine::Ptr notification)
-{
-    if (!notification.get())
-        return;
-
-    busyNotification = notification;
-    busyNotification->addToScene(busyScene);
-    busyNotification->visibilityChanged(true);
-}
-
 void ChatLog::setTypingNotification(ChatLine::Ptr notification)
 {
     typingNotification = notification;
@@ -618,6 +633,7 @@ void ChatLog::selectAll()
 
 void ChatLog::forceRelayout()
 {
+    TextMeasurer::clear();
     startResizeWorker();
 }
 
@@ -653,14 +669,48 @@ void ChatLog::checkVisibility()
     // enforce order
     std::sort(visibleLines.begin(), visibleLines.end(), ChatLine::lessThanRowIndex);
 
+    updateSceneLines();
+
     //if (!visibleLines.empty())
     //  qDebug() << "visible from " << visibleLines.first()->getRow() << "to " << visibleLines.last()->getRow() << " total " << visibleLines.size();
 }
 
+void ChatLog::updateSceneLines()
+{
+    // Only the lines within a page of the viewport are in the scene, the others are
+    // just laid out, which keeps the scene small and its index cheap however long the log.
+    // This only limits scene membership: every line still owns its content items,
+    // so memory still grows with the number of loaded messages
+    QRect rect = getVisibleRect();
+    auto lowerBound = std::lower_bound(lines.cbegin(), lines.cend(), rect.top() - rect.height(), ChatLine::lessThanBSRectBottom);
+    auto upperBound = std::lower_bound(lowerBound, lines.cend(), rect.bottom() + rect.height(), ChatLine::lessThanBSRectTop);
+    int first = lowerBound - lines.cbegin();
+    int last = upperBound - lines.cbegin();
+
+    for (ChatLine::Ptr line : sceneLines)
+    {
+        int row = line->getRow();
+        if (row < first || row >= last || lines[row] != line)
+            line->removeFromScene();
+    }
+
+    sceneLines.clear();
+    for (auto itr = lowerBound; itr != upperBound; ++itr)
+    {
+        if (!(*itr)->isInScene())
+            (*itr)->addToScene(scene);
+        sceneLines.append(*itr);
+    }
+}
+
 void ChatLog::scrollContentsBy(int dx, int dy)
 {
     QGraphicsView::scrollContentsBy(dx, dy);
     checkVisibility();
+
+    // a positive dy means we're scrolling up
+    if (dy > 0 && !workerTimer->isActive() && !measureWatcher->isRunning() && verticalScrollBar()->value() < verticalScrollBar()->pageStep())
+        emit scrolledNearTop();
 }
 
 void ChatLog::resizeEvent(QResizeEvent* ev)
@@ -669,7 +719,10 @@ void ChatLog::resizeEvent(QResizeEvent* ev)
 
     if (ev->size().width() != ev->oldSize().width())
     {
-        startResizeWorker();
+        if (!resizeTimer->isActive() && !lines.empty())
+            anchorWorker();
+
+        resizeTimer->start();
         stb = false; // let the resize worker handle it
     }
 
@@ -677,8 +730,6 @@ void ChatLog::resizeEvent(QResizeEvent* ev)
 
     if (stb)
         scrollToBottom();
-
-    updateBusyNotification();
 }
 
 void ChatLog::updateMultiSelectionRect()
@@ -715,15 +766,6 @@ void ChatLog::updateTypingNotification()
     notification->layout(useableWidth(), QPointF(0.0, posY));
 }
 
-void ChatLog::updateBusyNotification()
-{
-    if (busyNotification.get())
-    {
-        //repoisition the busy notification (centered)
-        busyNotification->layout(useableWidth(), getVisibleRect().topLeft() + QPointF(0, getVisibleRect().height()/2.0));
-    }
-}
-
 ChatLine::Ptr ChatLog::findLineByPosY(qreal yPos) const
 {
     auto itr = std::lower_bound(lines.cbegin(), lines.cend(), yPos, ChatLine::lessThanBSRectBottom);
@@ -761,23 +803,32 @@ void ChatLog::onSelectionTimerTimeout()
     }
 }
 
+void ChatLog::onMeasureFinished()
+{
+    workerLastIndex = 0;
+    workerTimer->start();
+}
+
 void ChatLog::onWorkerTimeout()
 {
-    // Fairly arbitrary but
-    // large values will make the UI unresponsive
+    // The texts are measured already, so laying out a step is cheap,
+    // but keep each tick short enough for the UI to stay responsive
     const int stepSize = 50;
+    const int stepBudget = 8; // ms
 
-    layout(workerLastIndex, workerLastIndex+stepSize, useableWidth());
-    workerLastIndex += stepSize;
+    QElapsedTimer stepTimer;
+    stepTimer.start();
+    while (workerLastIndex < lines.size() && stepTimer.elapsed() < stepBudget)
+    {
+        layout(workerLastIndex, workerLastIndex+stepSize, useableWidth());
+        workerLastIndex += stepSize;
+    }
 
     // done?
     if (workerLastIndex >= lines.size())
     {
         workerTimer->stop();
 
-        // switch back to the scene containing the chat messages
-        setScene(scene);
-
         // make sure everything gets updated
         updateSceneRect();
         checkVisibility();
@@ -792,9 +843,6 @@ void ChatLog::onWorkerTimeout()
 
         // don't keep a Ptr to the anchor line
         workerAnchorLine = ChatLine::Ptr();
-
-        // hidden during busy screen
-        verticalScrollBar()->show();
     }
 }
 
@@ -23,9 +23,11 @@
 #include <QGraphicsView>
 #include <QDateTime>
 #include <QMargins>
+#include <QFutureWatcher>
 
 #include "chatline.h"
 #include "chatmessage.h"
+#include "textmeasurer.h"
 
 class QGraphicsScene;
 class QGraphicsRectItem;
@@ -47,7 +49,6 @@ public:
     void clearSelection();
     void clear();
     void copySelectedText(bool toSelectionBuffer = false) const;
-    void setBusyNotification(ChatLine::Ptr notification);
     void setTypingNotification(ChatLine::Ptr notification);
     void setTypingNotificationVisible(bool visible);
     void scrollToLine(ChatLine::Ptr line);
@@ -67,6 +68,8 @@ public:
 
 signals:
     void selectionChanged();
+    /// Emitted when the user scrolls up to less than a page away from the first line
+    void scrolledNearTop();
 
 protected:
     QRectF calculateSceneRect() const;
@@ -82,8 +85,10 @@ protected:
     void reposition(int start, int end, qreal deltaY);
     void updateSceneRect();
     void checkVisibility();
+    void updateSceneLines();
     void scrollToBottom();
     void startResizeWorker();
+    void anchorWorker();
 
     virtual void mouseDoubleClickEvent(QMouseEvent* ev) final override;
     virtual void mousePressEvent(QMouseEvent* ev) final override;
@@ -97,12 +102,13 @@ protected:
 
     void updateMultiSelectionRect();
     void updateTypingNotification();
-    void updateBusyNotification();
 
     ChatLine::Ptr findLineByPosY(qreal yPos) const;
 
 private slots:
     void onSelectionTimerTimeout();
+    void startMeasurement();
+    void onMeasureFinished();
     void onWorkerTimeout();
 
 private:
@@ -124,11 +130,10 @@ private:
     QAction* copyAction = nullptr;
     QAction* selectAllAction = nullptr;
     QGraphicsScene* scene = nullptr;
-    QGraphicsScene* busyScene = nullptr;
     QVector<ChatLine::Ptr> lines;
     QList<ChatLine::Ptr> visibleLines;
+    QList<ChatLine::Ptr> sceneLines; ///< Lines near the viewport, the only ones added to the scene, all lines keep their content
     ChatLine::Ptr typingNotification;
-    ChatLine::Ptr busyNotification;
 
     // selection
     int selClickedRow = -1; //These 4 are only valid while selectionMode != None
@@ -141,6 +146,9 @@ private:
     QGraphicsRectItem* selGraphItem = nullptr;
     QTimer* selectionTimer = nullptr;
     QTimer* workerTimer = nullptr;
+    QFutureWatcher<void>* measureWatcher = nullptr;
+    TextMeasurer::CancelToken measureCancelled;
+    QTimer* resizeTimer = nullptr;
     AutoScrollDirection selectionScrollDir = NoDirection;
 
     //worker vars
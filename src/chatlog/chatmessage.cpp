@@ -19,6 +19,7 @@
 
 #include "chatmessage.h"
 #include "chatlinecontentproxy.h"
+#include "messageformatter.h"
 #include "content/text.h"
 #include "content/timestamp.h"
 #include "content/spinner.h"
@@ -27,7 +28,6 @@
 #include "content/notificationicon.h"
 
 #include "src/persistence/settings.h"
-#include "src/persistence/smileypack.h"
 #include "src/widget/style.h"
 
 #define NAME_COL_WIDTH 90.0
@@ -42,32 +42,30 @@ ChatMessage::Ptr ChatMessage::createChatMessage(const QString &sender, const QSt
 {
     ChatMessage::Ptr msg = ChatMessage::Ptr(new ChatMessage);
 
-    QString text = rawMessage.toHtmlEscaped();
+    QString text;
     QString senderText = sender;
 
     const QColor actionColor = QColor("#1818FF"); // has to match the color in innerStyle.css (div.action)
 
-    //smileys
-    if (Settings::getInstance().getUseEmoticons())
-        text = SmileyPack::getInstance().smileyfied(text);
-
-    //quotes (green text)
-    text = detectQuotes(detectAnchors(text), type);
-
     switch(type)
     {
     case ACTION:
         senderText = "*";
-        text = wrapDiv(QString("%1 %2").arg(sender.toHtmlEscaped(), text), "action");
+        text = QString("<div class=action>%1 ").arg(sender.toHtmlEscaped());
         msg->setAsAction();
         break;
     case ALERT:
-        text = wrapDiv(text, "alert");
+        text = "<div class=alert>";
         break;
     default:
-        text = wrapDiv(text, "msg");
+        text = "<div class=msg>";
     }
 
+    // smileys, links and quotes (green text)
+    // don't quote the first line of an action message, so it can start with a '>'
+    MessageFormatter::appendRichText(text, rawMessage, Settings::getInstance().getUseEmoticons(), type != ACTION);
+    text += "</div>";
+
     // Note: Eliding cannot be enabled for RichText items. (QTBUG-17207)
     msg->addColumn(new Text(senderText, isMe ? Style::getFont(Style::BigBold) : Style::getFont(Style::Big), true, sender, type == ACTION ? actionColor : Qt::black), ColumnFormat(NAME_COL_WIDTH, ColumnFormat::FixedSize, ColumnFormat::Right));
     msg->addColumn(new Text(text, Style::getFont(Style::Big), false, ((type == ACTION) && isMe) ? QString("%1 %2").arg(sender, rawMessage) : rawMessage), ColumnFormat(1.0, ColumnFormat::VariableSize));
@@ -126,16 +124,6 @@ ChatMessage::Ptr ChatMessage::createTypingNotification()
     return msg;
 }
 
-ChatMessage::Ptr ChatMessage::createBusyNotification()
-{
-    ChatMessage::Ptr msg = ChatMessage::Ptr(new ChatMessage);
-
-    // TODO: Bigger font
-    msg->addColumn(new Text(QObject::tr("Resizing"), Style::getFont(Style::ExtraBig), false, ""), ColumnFormat(1.0, ColumnFormat::VariableSize, ColumnFormat::Center));
-
-    return msg;
-}
-
 void ChatMessage::markAsSent(const QDateTime &time)
 {
     // remove the spinner and replace it by $time
@@ -174,78 +162,3 @@ void ChatMessage::hideDate()
     if (c)
         c->hide();
 }
-
-QString ChatMessage::detectAnchors(const QString &str)
-{
-    QString out;
-
-    // detect URIs
-    QRegExp exp("("
-                "(?:\\b)((www\\.)|(http[s]?|ftp)://)" // (protocol)://(printable - non-special character)
-                // http://ONEORMOREALHPA-DIGIT
-                "\\w+\\S+)" // any other character, lets domains and other
-                "|(?:\\b)(file:///.*$)" //link to a local file, valid until the end of the line
-                "|(?:\\b)(tox:[a-zA-Z\\d]{76}$)" //link with full user address
-                "|(?:\\b)(mailto:\\S+@\\S+\\.\\S+)" //@mail link
-                "|(?:\\b)(tox:\\S+@\\S+)"); // starts with `tox` then : and only alpha-digits till the end
-                // also accepts tox:agilob@net as simplified TOX ID
-    //support for multi-line text
-    QStringList messageLines = str.split("\n");
-    QStringList outLines;
-    for (int i = 0; i < messageLines.size(); ++i)
-    {
-        out = messageLines.at(i);
-        int offset = 0;
-        while ((offset = exp.indexIn(out, offset)) != -1)
-        {
-            QString url = exp.cap();
-            // If there's a trailing " it's a HTML attribute, e.g. a smiley img's title=":tox:"
-            if (url == "tox:\"")
-            {
-                offset += url.length();
-                continue;
-            }
-            QString htmledUrl;
-            // add scheme if not specified
-            if (exp.cap(2) == "www.")
-                htmledUrl = QString("<a href=\"http://%1\">%1</a>").arg(url);
-            else
-                htmledUrl = QString("<a href=\"%1\">%1</a>").arg(url);
-            out.replace(offset, exp.cap().length(), htmledUrl);
-            offset += htmledUrl.length();
-        }
-        outLines.push_back(out);
-    }
-    return outLines.join("\n");
-}
-
-QString ChatMessage::detectQuotes(const QString& str, MessageType type)
-{
-    // detect text quotes
-    QStringList messageLines = str.split("\n");
-    QString quotedText;
-    for (int i = 0; i < messageLines.size(); ++i)
-    {
-        // don't quote first line in action message. This makes co-existence of
-        // quotes and action messages possible, since only first line can cause
-        // problems in case where there is quote in it used.
-        if (QRegExp("^(&gt;|＞).*").exactMatch(messageLines[i])) {
-            if (i > 0 || type != ACTION)
-                quotedText += "<span class=quote>" + messageLines[i] + "</span>";
-            else
-                quotedText += messageLines[i];
-        } else {
-            quotedText += messageLines[i];
-        }
-
-        if (i < messageLines.size() - 1)
-            quotedText += "<br/>";
-    }
-
-    return quotedText;
-}
-
-QString ChatMessage::wrapDiv(const QString &str, const QString &div)
-{
-    return QString("<div class=%1>%2</div>").arg(div, str);
-}
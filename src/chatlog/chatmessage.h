@@ -51,7 +51,6 @@ public:
     static ChatMessage::Ptr createChatInfoMessage(const QString& rawMessage, SystemMessageType type, const QDateTime& date);
     static ChatMessage::Ptr createFileTransferMessage(const QString& sender, ToxFile file, bool isMe, const QDateTime& date);
     static ChatMessage::Ptr createTypingNotification();
-    static ChatMessage::Ptr createBusyNotification();
 
     void markAsSent(const QDateTime& time);
     QString toString() const;
@@ -60,11 +59,6 @@ public:
     void hideSender();
     void hideDate();
 
-protected:
-    static QString detectAnchors(const QString& str);
-    static QString detectQuotes(const QString& str, MessageType type);
-    static QString wrapDiv(const QString& str, const QString& div);
-
 private:
     bool action = false;
 };
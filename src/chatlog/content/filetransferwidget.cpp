@@ -379,9 +379,16 @@ void FileTransferWidget::fileTransferRemotePausedUnpaused(ToxFile file, bool pau
 
 void FileTransferWidget::fileTransferBrokenUnbroken(ToxFile file, bool broken)
 {
-    /// TODO: Handle broken transfer differently once we have resuming code
-    if (broken)
-        onFileTransferCancelled(file);
+    if (fileInfo != file)
+        return;
+
+    // The transfer may come back with a new file number, which we need for our buttons
+    fileInfo = file;
+
+    setBackgroundColor(Style::getColor(broken ? Style::Yellow : Style::LightGrey), false);
+
+    setupButtons();
+    update();
 }
 
 QString FileTransferWidget::getHumanReadableSize(qint64 size)
@@ -452,13 +459,18 @@ void FileTransferWidget::setupButtons()
         }
         break;
     }
+
+    // A broken transfer can only be cancelled until our friend comes back
+    ui->topButton->setEnabled(fileInfo.status != ToxFile::BROKEN);
 }
 
 void FileTransferWidget::handleButton(QPushButton *btn)
 {
     if (fileInfo.direction == ToxFile::SENDING)
     {
-        if (btn->objectName() == "cancel")
+        if (btn->objectName() == "cancel" && fileInfo.status == ToxFile::BROKEN)
+            Core::getInstance()->cancelBrokenFile(fileInfo.friendId, fileInfo.resumeFileId);
+        else if (btn->objectName() == "cancel")
             Core::getInstance()->cancelFileSend(fileInfo.friendId, fileInfo.fileNum);
         else if (btn->objectName() == "pause")
             Core::getInstance()->pauseResumeFileSend(fileInfo.friendId, fileInfo.fileNum);
@@ -467,7 +479,9 @@ void FileTransferWidget::handleButton(QPushButton *btn)
     }
     else // receiving or paused
     {
-        if (btn->objectName() == "cancel")
+        if (btn->objectName() == "cancel" && fileInfo.status == ToxFile::BROKEN)
+            Core::getInstance()->cancelBrokenFile(fileInfo.friendId, fileInfo.resumeFileId);
+        else if (btn->objectName() == "cancel")
             Core::getInstance()->cancelFileRecv(fileInfo.friendId, fileInfo.fileNum);
         else if (btn->objectName() == "pause")
             Core::getInstance()->pauseResumeFileRecv(fileInfo.friendId, fileInfo.fileNum);
@@ -65,9 +65,26 @@ void Text::setWidth(qreal w)
         elidedText = metrics.elidedText(text, Qt::ElideRight, width);
     }
 
+    // Off screen, a size measured in advance is enough, the document is only laid out once visible
+    TextMeasurer::Measurement measurement;
+    if (!keepInMemory && TextMeasurer::lookup(getMeasureRequest(width), measurement))
+    {
+        if (size != measurement.size)
+            prepareGeometryChange();
+
+        size = measurement.size;
+        ascent = measurement.ascent;
+        return;
+    }
+
     regenerate();
 }
 
+TextMeasurer::Request Text::getMeasureRequest(qreal width) const
+{
+    return {text, defFont, elide, width};
+}
+
 void Text::selectionMouseMove(QPointF scenePos)
 {
     if (!doc)
@@ -270,6 +287,7 @@ void Text::regenerate()
 
         // get the new width and height
         size = idealSize();
+        TextMeasurer::insert(getMeasureRequest(width), {size, ascent});
 
         dirty = false;
     }
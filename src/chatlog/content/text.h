@@ -21,6 +21,7 @@
 #define TEXT_H
 
 #include "../chatlinecontent.h"
+#include "../textmeasurer.h"
 
 #include <QFont>
 
@@ -57,6 +58,8 @@ public:
     void hoverMoveEvent(QGraphicsSceneHoverEvent* event) final override;
 
     virtual QString getText() const final;
+    /// What TextMeasurer needs to measure this text at the given width
+    TextMeasurer::Request getMeasureRequest(qreal width) const;
 
 protected:
     // dynamic resource management
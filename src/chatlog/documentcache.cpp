@@ -19,28 +19,122 @@
 
 #include "documentcache.h"
 #include "customtextdocument.h"
+#include <QTimer>
+
+DocumentCache::DocumentCache()
+    : capacity{defaultCapacity}, trimScheduled{false}, stats{0, 0, 0, 0, 0, 0}
+{
+    clock.start();
+}
 
 DocumentCache::~DocumentCache()
 {
     while (!documents.isEmpty())
-        delete documents.pop();
+        delete documents.pop().doc;
 }
 
 QTextDocument* DocumentCache::pop()
 {
+    QTextDocument* doc;
     if (documents.empty())
-        documents.push(new CustomTextDocument);
+    {
+        ++stats.misses;
+        doc = new CustomTextDocument;
+    }
+    else
+    {
+        ++stats.hits;
+        doc = documents.pop().doc;
+    }
 
-    return documents.pop();
+    stats.idle = documents.size();
+    ++stats.used;
+    stats.peakUsed = qMax(stats.peakUsed, stats.used);
+    return doc;
 }
 
 void DocumentCache::push(QTextDocument *doc)
 {
-    if (doc)
+    if (!doc)
+        return;
+
+    --stats.used;
+
+    // The most recently used documents are reused first, so the oldest ones go
+    if (documents.size() >= capacity)
+        evictTo(capacity - 1);
+
+    if (capacity <= 0)
     {
-        doc->clear();
-        documents.push(doc);
+        ++stats.evictions;
+        delete doc;
+        return;
     }
+
+    // Drop the content and layout now, an idle document shouldn't hold on to a whole message
+    doc->clear();
+    documents.push({doc, clock.elapsed()});
+    stats.idle = documents.size();
+
+    if (!trimScheduled && documents.size() > minIdle)
+    {
+        trimScheduled = true;
+        QTimer::singleShot(idleTimeout, this, SLOT(trimIdle()));
+    }
+}
+
+void DocumentCache::setCapacity(int newCapacity)
+{
+    capacity = qMax(0, newCapacity);
+    evictTo(capacity);
+}
+
+int DocumentCache::getCapacity() const
+{
+    return capacity;
+}
+
+DocumentCache::Stats DocumentCache::getStats() const
+{
+    return stats;
+}
+
+void DocumentCache::trimIdle()
+{
+    trimScheduled = false;
+
+    // The stack is ordered by age, the bottom is the longest idle
+    qint64 now = clock.elapsed();
+    int expired = 0;
+    while (expired < documents.size() - minIdle && now - documents[expired].idleSince >= idleTimeout)
+        ++expired;
+
+    for (int i = 0; i < expired; ++i)
+        delete documents[i].doc;
+
+    documents.remove(0, expired);
+    stats.evictions += expired;
+    stats.idle = documents.size();
+
+    if (documents.size() > minIdle)
+    {
+        trimScheduled = true;
+        QTimer::singleShot(idleTimeout, this, SLOT(trimIdle()));
+    }
+}
+
+void DocumentCache::evictTo(int count)
+{
+    int excess = documents.size() - qMax(0, count);
+    if (excess <= 0)
+        return;
+
+    for (int i = 0; i < excess; ++i)
+        delete documents[i].doc;
+
+    documents.remove(0, excess);
+    stats.evictions += excess;
+    stats.idle = documents.size();
 }
 
 DocumentCache &DocumentCache::getInstance()
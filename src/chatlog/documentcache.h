@@ -20,12 +20,29 @@
 #ifndef DOCUMENTCACHE_H
 #define DOCUMENTCACHE_H
 
+#include <QObject>
 #include <QStack>
+#include <QElapsedTimer>
 
 class QTextDocument;
 
-class DocumentCache
+/// Bounded pool of the text documents used by the visible chat texts
+/// Returned documents are cleared, and the ones left idle for a while are freed.
+/// Must only be used from the GUI thread
+class DocumentCache : public QObject
 {
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        quint64 hits; ///< Pops served by an idle document
+        quint64 misses; ///< Pops that had to create a document
+        quint64 evictions; ///< Documents freed because the pool was full or they were idle too long
+        int idle;
+        int used; ///< Documents currently handed out
+        int peakUsed;
+    };
+
 public:
     ~DocumentCache();
     static DocumentCache& getInstance();
@@ -33,13 +50,38 @@ public:
     QTextDocument* pop();
     void push(QTextDocument* doc);
 
+    /// Sets how many idle documents are kept at most, extra ones are freed
+    void setCapacity(int capacity);
+    int getCapacity() const;
+    Stats getStats() const;
+
 protected:
-    DocumentCache() {}
+    DocumentCache();
     DocumentCache(DocumentCache&) = delete;
     DocumentCache& operator=(const DocumentCache&) = delete;
 
+private slots:
+    void trimIdle();
+
 private:
-    QStack<QTextDocument*> documents;
+    void evictTo(int count);
+
+private:
+    struct IdleDocument
+    {
+        QTextDocument* doc;
+        qint64 idleSince; ///< In msecs of the clock
+    };
+
+    QStack<IdleDocument> documents;
+    int capacity;
+    bool trimScheduled;
+    QElapsedTimer clock;
+    Stats stats;
+
+    static constexpr int defaultCapacity = 64;
+    static constexpr int minIdle = 8; ///< Kept even when idle for long, a chat switch needs a few right away
+    static constexpr int idleTimeout = 30000; ///< msecs
 };
 
 #endif // DOCUMENTCACHE_H
@@ -0,0 +1,241 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "messageformatter.h"
+#include "src/persistence/smileypack.h"
+
+static bool isWordChar(QChar c)
+{
+    return c.isLetterOrNumber() || c.isMark() || c == '_';
+}
+
+/// Like QString::indexOf, but doesn't look past end
+static int indexIn(const QString& str, QChar c, int from, int end)
+{
+    const QChar* data = str.constData();
+    for (int i = from; i < end; ++i)
+    {
+        if (data[i] == c)
+            return i;
+    }
+    return -1;
+}
+
+static bool hasPrefixAt(const QString& str, int pos, const QLatin1String& prefix)
+{
+    return str.midRef(pos, prefix.size()) == prefix;
+}
+
+void MessageFormatter::appendRichText(QString& out, const QString& message, bool useEmoticons, bool quoteFirstLine)
+{
+    // Markup makes the message longer, this avoids most of the reallocations
+    out.reserve(out.size() + message.size() * 2);
+
+    int pos = 0;
+    bool firstLine = true;
+    while (true)
+    {
+        bool quote = (quoteFirstLine || !firstLine) && pos < message.size()
+                && (message[pos] == '>' || message[pos] == QChar(0xFF1E)); // or '＞'
+
+        if (quote)
+            out += QLatin1String("<span class=quote>");
+
+        pos = appendLine(out, message, pos, useEmoticons);
+
+        if (quote)
+            out += QLatin1String("</span>");
+
+        if (pos >= message.size())
+            break;
+
+        out += QLatin1String("<br/>");
+        ++pos; // skip the '\n'
+        firstLine = false;
+    }
+}
+
+int MessageFormatter::appendLine(QString& out, const QString& message, int pos, bool useEmoticons)
+{
+    const QChar* data = message.constData();
+    const int size = message.size();
+
+    while (pos < size && data[pos] != '\n')
+    {
+        if (data[pos].isSpace())
+        {
+            out += data[pos];
+            ++pos;
+            continue;
+        }
+
+        int wordStart = pos;
+        while (pos < size && !data[pos].isSpace())
+            ++pos;
+
+        pos = appendWord(out, message, wordStart, pos, useEmoticons);
+    }
+
+    return pos;
+}
+
+int MessageFormatter::appendWord(QString& out, const QString& message, int start, int end, bool useEmoticons)
+{
+    const QChar* data = message.constData();
+
+    // if a word is key of a smiley, replace it by its corresponding image in Rich Text
+    if (useEmoticons)
+    {
+        SmileyPack& smileyPack = SmileyPack::getInstance();
+        QStringRef word = message.midRef(start, end - start);
+        bool escaped = false;
+        for (int i = start; i < end && !escaped; ++i)
+            escaped = data[i] == '<' || data[i] == '>' || data[i] == '&' || data[i] == '"';
+
+        // emoticons are keyed by their escaped form
+        QString escapedWord;
+        if (escaped)
+        {
+            escapedWord = word.toString().toHtmlEscaped();
+            word = QStringRef(&escapedWord);
+        }
+
+        if (smileyPack.isEmoticon(word))
+        {
+            out += smileyPack.getAsRichText(word.toString());
+            return end;
+        }
+    }
+
+    // detect URIs, a link starts on a word boundary
+    for (int pos = start; pos < end; ++pos)
+    {
+        if (pos > start && isWordChar(data[pos - 1]))
+            continue;
+
+        bool addScheme = false;
+        int linkEnd = findLinkEnd(message, pos, end, addScheme);
+        if (linkEnd < 0)
+            continue;
+
+        appendEscaped(out, data + start, pos - start);
+
+        QString link;
+        appendEscaped(link, data + pos, linkEnd - pos);
+        out += QLatin1String("<a href=\"");
+        if (addScheme)
+            out += QLatin1String("http://");
+        out += link;
+        out += QLatin1String("\">");
+        out += link;
+        out += QLatin1String("</a>");
+        return linkEnd;
+    }
+
+    appendEscaped(out, data + start, end - start);
+    return end;
+}
+
+int MessageFormatter::findLinkEnd(const QString& message, int pos, int wordEnd, bool& addScheme)
+{
+    const QChar* data = message.constData();
+
+    // (protocol)://(printable - non-special character), at least two characters after it
+    static const QLatin1String webPrefixes[] = {QLatin1String("http://"), QLatin1String("https://"),
+                                                QLatin1String("ftp://"), QLatin1String("www.")};
+    for (const QLatin1String& prefix : webPrefixes)
+    {
+        if (!hasPrefixAt(message, pos, prefix))
+            continue;
+
+        int rest = pos + prefix.size();
+        if (wordEnd - rest < 2 || !isWordChar(data[rest]))
+            return -1;
+
+        // add scheme if not specified
+        addScheme = prefix == QLatin1String("www.");
+        return wordEnd;
+    }
+
+    // link to a local file, valid until the end of the line
+    if (hasPrefixAt(message, pos, QLatin1String("file:///")))
+    {
+        int lineEnd = message.indexOf('\n', pos);
+        return lineEnd < 0 ? message.size() : lineEnd;
+    }
+
+    // mail link, user@host.domain
+    if (hasPrefixAt(message, pos, QLatin1String("mailto:")))
+    {
+        int rest = pos + 7;
+        int at = indexIn(message, '@', rest + 1, wordEnd);
+        if (at < 0)
+            return -1;
+
+        int dot = indexIn(message, '.', at + 2, wordEnd - 1);
+        if (dot < 0)
+            return -1;
+
+        return wordEnd;
+    }
+
+    // link with full user address, or a simplified Tox ID like tox:agilob@net
+    if (hasPrefixAt(message, pos, QLatin1String("tox:")))
+    {
+        int rest = pos + 4;
+        bool fullAddress = wordEnd - rest == 76;
+        for (int i = rest; i < wordEnd && fullAddress; ++i)
+            fullAddress = data[i].unicode() < 128 && data[i].isLetterOrNumber();
+
+        if (fullAddress)
+            return wordEnd;
+
+        int at = indexIn(message, '@', rest + 1, wordEnd - 1);
+        if (at < 0)
+            return -1;
+
+        return wordEnd;
+    }
+
+    return -1;
+}
+
+void MessageFormatter::appendEscaped(QString& out, const QChar* data, int length)
+{
+    for (int i = 0; i < length; ++i)
+    {
+        switch (data[i].unicode())
+        {
+        case '<':
+            out += QLatin1String("&lt;");
+            break;
+        case '>':
+            out += QLatin1String("&gt;");
+            break;
+        case '&':
+            out += QLatin1String("&amp;");
+            break;
+        case '"':
+            out += QLatin1String("&quot;");
+            break;
+        default:
+            out += data[i];
+        }
+    }
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MESSAGEFORMATTER_H
+#define MESSAGEFORMATTER_H
+
+#include <QString>
+
+/// Turns a plain text chat message into the rich text shown in the chat log
+/// Escaping, emoticons, links and quotes are all handled in one pass over the message.
+class MessageFormatter
+{
+public:
+    /// Appends the rich text of message to out
+    /// If quoteFirstLine is false, a first line starting with '>' isn't shown as a quote,
+    /// which lets action messages start with one
+    static void appendRichText(QString& out, const QString& message, bool useEmoticons, bool quoteFirstLine);
+
+private:
+    MessageFormatter()=delete;
+
+    /// Appends the line starting at pos, returns the position of its end
+    static int appendLine(QString& out, const QString& message, int pos, bool useEmoticons);
+    /// Appends the word between start and end, returns where the next token starts
+    static int appendWord(QString& out, const QString& message, int start, int end, bool useEmoticons);
+    /// Returns the end of the link starting at pos, or -1 if there is none
+    static int findLinkEnd(const QString& message, int pos, int wordEnd, bool& addScheme);
+    static void appendEscaped(QString& out, const QChar* data, int length);
+};
+
+#endif // MESSAGEFORMATTER_H
@@ -0,0 +1,186 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "textmeasurer.h"
+#include "documentcache.h"
+#include "src/persistence/settings.h"
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QAbstractTextDocumentLayout>
+#include <QFontMetrics>
+#include <QImage>
+#include <QUrl>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+
+QMutex TextMeasurer::cacheLock;
+QCache<TextMeasurer::Key, TextMeasurer::Measurement> TextMeasurer::cache{TextMeasurer::maxCachedMeasurements};
+int TextMeasurer::generation = 0;
+QThreadPool TextMeasurer::jobPool;
+QThreadPool TextMeasurer::chunkPool;
+
+/// A document that lays out smileys without loading their pixmaps, which only the GUI thread may do
+class MeasureDocument : public QTextDocument
+{
+public:
+    MeasureDocument(const QString& css, int emojiSize)
+        : emoji{emojiSize, emojiSize, QImage::Format_ARGB32_Premultiplied}
+    {
+        setDefaultStyleSheet(css);
+        setUndoRedoEnabled(false);
+        setUseDesignMetrics(false);
+    }
+
+protected:
+    QVariant loadResource(int type, const QUrl& name) override
+    {
+        if (type == QTextDocument::ImageResource && name.scheme() == "key")
+            return emoji;
+
+        return QTextDocument::loadResource(type, name);
+    }
+
+private:
+    QImage emoji;
+};
+
+bool TextMeasurer::Key::operator==(const Key& other) const
+{
+    return textHash == other.textHash && textSeedHash == other.textSeedHash
+            && textLength == other.textLength && fontHash == other.fontHash
+            && width == other.width && elide == other.elide;
+}
+
+uint qHash(const TextMeasurer::Key& key)
+{
+    return key.textHash ^ key.fontHash ^ (key.width * 31) ^ key.elide;
+}
+
+TextMeasurer::Key TextMeasurer::makeKey(const Request& request)
+{
+    return {qHash(request.text), qHash(request.text, 0x9e3779b9), request.text.size(),
+            qHash(request.font.key()), qRound(request.width), request.elide};
+}
+
+QFuture<void> TextMeasurer::measure(QVector<Request> requests, CancelToken cancelled)
+{
+    // The stylesheet comes from the GUI thread's documents, so we lay out exactly like them
+    QTextDocument* guiDoc = DocumentCache::getInstance().pop();
+    QString css = guiDoc->defaultStyleSheet();
+    DocumentCache::getInstance().push(guiDoc);
+    int emojiSize = Settings::getInstance().getEmojiFontPointSize();
+    int startGeneration;
+    {
+        QMutexLocker locker(&cacheLock);
+        startGeneration = generation;
+    }
+
+    // One job at a time, a cancelled job stops after its current texts and the next one starts
+    jobPool.setMaxThreadCount(1);
+
+    return QtConcurrent::run(&jobPool, [=]() mutable
+    {
+        if (cancelled->load())
+            return;
+
+        {
+            QMutexLocker locker(&cacheLock);
+            auto isCached = [](const Request& request) { return cache.contains(makeKey(request)); };
+            requests.erase(std::remove_if(requests.begin(), requests.end(), isCached), requests.end());
+        }
+
+        // Each chunk reuses a single document, creating one per text would cost as much as the layout
+        int chunkCount = qMax(1, QThread::idealThreadCount());
+        int chunkSize = requests.size() / chunkCount + 1;
+        QVector<QFuture<void>> chunks;
+        for (int i = 0; i < requests.size(); i += chunkSize)
+        {
+            QVector<Request> chunk = requests.mid(i, chunkSize);
+            chunks << QtConcurrent::run(&chunkPool, [=]()
+            {
+                MeasureDocument doc(css, emojiSize);
+                for (const Request& request : chunk)
+                {
+                    if (cancelled->load())
+                        return;
+
+                    Measurement measurement = measure(doc, request);
+                    QMutexLocker locker(&cacheLock);
+                    if (generation != startGeneration)
+                        return;
+
+                    cache.insert(makeKey(request), new Measurement(measurement));
+                }
+            });
+        }
+
+        for (QFuture<void>& chunk : chunks)
+            chunk.waitForFinished();
+    });
+}
+
+bool TextMeasurer::lookup(const Request& request, Measurement& measurement)
+{
+    QMutexLocker locker(&cacheLock);
+    Measurement* cached = cache.object(makeKey(request));
+    if (!cached)
+        return false;
+
+    measurement = *cached;
+    return true;
+}
+
+void TextMeasurer::insert(const Request& request, const Measurement& measurement)
+{
+    QMutexLocker locker(&cacheLock);
+    cache.insert(makeKey(request), new Measurement(measurement));
+}
+
+void TextMeasurer::clear()
+{
+    QMutexLocker locker(&cacheLock);
+    cache.clear();
+    ++generation;
+}
+
+TextMeasurer::Measurement TextMeasurer::measure(QTextDocument& doc, const Request& request)
+{
+    doc.setDefaultFont(request.font);
+
+    if (!request.elide)
+        doc.setHtml(request.text);
+    else
+        doc.setPlainText(QFontMetrics(request.font).elidedText(request.text, Qt::ElideRight, request.width));
+
+    QTextOption opt;
+    opt.setWrapMode(request.elide ? QTextOption::NoWrap : QTextOption::WrapAtWordBoundaryOrAnywhere);
+    doc.setDefaultTextOption(opt);
+
+    doc.setTextWidth(request.width);
+    doc.documentLayout()->update();
+
+    Measurement measurement{QSizeF(qMin(doc.idealWidth(), request.width), doc.size().height()), 0.0};
+    if (doc.firstBlock().layout()->lineCount() > 0)
+        measurement.ascent = doc.firstBlock().layout()->lineAt(0).ascent();
+
+    return measurement;
+}
@@ -0,0 +1,96 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTMEASURER_H
+#define TEXTMEASURER_H
+
+#include <QString>
+#include <QFont>
+#include <QSizeF>
+#include <QVector>
+#include <QCache>
+#include <QMutex>
+#include <QFuture>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+class QTextDocument;
+
+/// Measures chat texts on worker threads, and caches their size by content, font and width
+/// A relayout of the chat log then only has to position items on the GUI thread.
+/// The class is thread safe
+class TextMeasurer
+{
+public:
+    struct Measurement
+    {
+        QSizeF size;
+        qreal ascent;
+    };
+
+    struct Request
+    {
+        QString text; ///< May contain html, unless elided
+        QFont font;
+        bool elide;
+        qreal width;
+    };
+
+public:
+    /// Set to non-zero to stop a measurement job before its remaining texts
+    using CancelToken = QSharedPointer<QAtomicInt>;
+
+    /// Measures the requests that aren't cached yet on our own thread pools
+    static QFuture<void> measure(QVector<Request> requests, CancelToken cancelled);
+    /// Returns false if this text wasn't measured at this width yet
+    static bool lookup(const Request& request, Measurement& measurement);
+    static void insert(const Request& request, const Measurement& measurement);
+    /// Forgets all measurements, needed when the stylesheet or smiley size changes
+    static void clear();
+
+private:
+    TextMeasurer()=delete;
+
+    struct Key
+    {
+        uint textHash, textSeedHash; ///< Two hashes with different seeds, collisions would misplace lines
+        int textLength;
+        uint fontHash;
+        int width;
+        bool elide;
+
+        bool operator==(const Key& other) const;
+    };
+    friend uint qHash(const Key& key);
+
+    static Key makeKey(const Request& request);
+    /// Lays out the text like Text::regenerate does
+    static Measurement measure(QTextDocument& doc, const Request& request);
+
+private:
+    static QMutex cacheLock;
+    static QCache<Key, Measurement> cache;
+    static int generation; ///< Bumped by clear, so measurements still running are discarded
+    static constexpr int maxCachedMeasurements = 100000;
+    static QThreadPool jobPool; ///< Runs one job at a time, so restarts don't stack up
+    static QThreadPool chunkPool; ///< Measures the chunks of the running job
+};
+
+#endif // TEXTMEASURER_H
@@ -55,6 +55,7 @@
 
 const QString Core::CONFIG_FILE_NAME = "data";
 const QString Core::TOX_EXT = ".tox";
+const QVector<int> Core::latencyBuckets{1, 2, 5, 10, 20, 50, 100, 250};
 QThread* Core::coreThread{nullptr};
 
 #define MAX_GROUP_MESSAGE_LEN 1024
@@ -63,6 +64,8 @@ Core::Core(QThread *CoreThread, Profile& profile) :
     tox(nullptr), av(nullptr), profile(profile), ready{false}
 {
     coreThread = CoreThread;
+    loopStats.sendLatency.resize(latencyBuckets.size() + 1);
+    loopTimer.start();
 
     Audio::getInstance();
 
@@ -70,6 +73,10 @@ Core::Core(QThread *CoreThread, Profile& profile) :
     toxTimer = new QTimer(this);
     toxTimer->setSingleShot(true);
     connect(toxTimer, &QTimer::timeout, this, &Core::process);
+    saveTimer = new QTimer(this);
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(saveDelay);
+    connect(saveTimer, &QTimer::timeout, this, &Core::saveToxSaveNow);
     connect(&Settings::getInstance(), &Settings::dhtServerListChanged, this, &Core::process);
 
 }
@@ -314,6 +321,7 @@ void Core::start()
     if (isNewProfile)
     {
         profile.saveToxSave();
+        profile.flushToxSave();
         emit idSet(getSelfId().toString());
     }
 
@@ -343,6 +351,22 @@ void Core::process()
 
     static int tolerance = CORE_DISCONNECT_TOLERANCE;
     tox_iterate(tox);
+    CoreFile::sendPendingChunks(this);
+    CoreFile::expireBrokenFiles(this);
+
+    {
+        QMutexLocker locker(&loopStatsLock);
+        ++loopStats.iterations;
+        if (sendRequested)
+        {
+            sendRequested = false;
+            qint64 latency = sendRequestTimer.elapsed();
+            int bucket = 0;
+            while (bucket < latencyBuckets.size() && latency >= latencyBuckets[bucket])
+                ++bucket;
+            ++loopStats.sendLatency[bucket];
+        }
+    }
 
 #ifdef DEBUG
     //we want to see the debug messages immediately
@@ -547,7 +571,7 @@ void Core::acceptFriendRequest(const QString& userId)
     }
     else
     {
-        profile.saveToxSave();
+        scheduleToxSave();
         emit friendAdded(friendId, userId);
         emit friendshipChanged(friendId);
     }
@@ -596,7 +620,7 @@ void Core::requestFriendship(const QString& friendAddress, const QString& messag
             emit friendshipChanged(friendId);
         }
     }
-    profile.saveToxSave();
+    scheduleToxSave();
 }
 
 int Core::sendMessage(uint32_t friendId, const QString& message)
@@ -605,6 +629,7 @@ int Core::sendMessage(uint32_t friendId, const QString& message)
     CString cMessage(message);
     int receipt = tox_friend_send_message(tox, friendId, TOX_MESSAGE_TYPE_NORMAL,
                                           cMessage.data(), cMessage.size(), nullptr);
+    wakeUp();
     emit messageSentResult(friendId, message, receipt);
     return receipt;
 }
@@ -615,6 +640,7 @@ int Core::sendAction(uint32_t friendId, const QString &action)
     CString cMessage(action);
     int receipt = tox_friend_send_message(tox, friendId, TOX_MESSAGE_TYPE_ACTION,
                                   cMessage.data(), cMessage.size(), nullptr);
+    wakeUp();
     emit messageSentResult(friendId, action, receipt);
     return receipt;
 }
@@ -624,6 +650,8 @@ void Core::sendTyping(uint32_t friendId, bool typing)
     bool ret = tox_self_set_typing(tox, friendId, typing, nullptr);
     if (ret == false)
         emit failedToSetTyping(typing);
+    else
+        wakeUp();
 }
 
 void Core::sendGroupMessage(int groupId, const QString& message)
@@ -637,6 +665,7 @@ void Core::sendGroupMessage(int groupId, const QString& message)
         if (ret == -1)
             emit groupSentResult(groupId, message, ret);
     }
+    wakeUp();
 }
 
 void Core::sendGroupAction(int groupId, const QString& message)
@@ -650,6 +679,7 @@ void Core::sendGroupAction(int groupId, const QString& message)
         if (ret == -1)
             emit groupSentResult(groupId, message, ret);
     }
+    wakeUp();
 }
 
 void Core::changeGroupTitle(int groupId, const QString& title)
@@ -663,6 +693,7 @@ void Core::changeGroupTitle(int groupId, const QString& title)
 void Core::sendFile(uint32_t friendId, QString Filename, QString FilePath, long long filesize)
 {
     CoreFile::sendFile(this, friendId, Filename, FilePath, filesize);
+    wakeUp();
 }
 
 void Core::sendAvatarFile(uint32_t friendId, const QByteArray& data)
@@ -673,31 +704,48 @@ void Core::sendAvatarFile(uint32_t friendId, const QByteArray& data)
 void Core::pauseResumeFileSend(uint32_t friendId, uint32_t fileNum)
 {
     CoreFile::pauseResumeFileSend(this, friendId, fileNum);
+    wakeUp();
 }
 
 void Core::pauseResumeFileRecv(uint32_t friendId, uint32_t fileNum)
 {
     CoreFile::pauseResumeFileRecv(this, friendId, fileNum);
+    wakeUp();
+}
+
+void Core::setFileSendPinned(uint32_t friendId, uint32_t fileNum, bool pinned)
+{
+    CoreFile::setFileSendPinned(friendId, fileNum, pinned);
 }
 
 void Core::cancelFileSend(uint32_t friendId, uint32_t fileNum)
 {
     CoreFile::cancelFileSend(this, friendId, fileNum);
+    wakeUp();
 }
 
 void Core::cancelFileRecv(uint32_t friendId, uint32_t fileNum)
 {
     CoreFile::cancelFileRecv(this, friendId, fileNum);
+    wakeUp();
+}
+
+void Core::cancelBrokenFile(uint32_t friendId, const QByteArray& resumeFileId)
+{
+    CoreFile::cancelBrokenFile(this, friendId, resumeFileId);
+    wakeUp();
 }
 
 void Core::rejectFileRecvRequest(uint32_t friendId, uint32_t fileNum)
 {
     CoreFile::rejectFileRecvRequest(this, friendId, fileNum);
+    wakeUp();
 }
 
 void Core::acceptFileRecvRequest(uint32_t friendId, uint32_t fileNum, QString path)
 {
     CoreFile::acceptFileRecvRequest(this, friendId, fileNum, path);
+    wakeUp();
 }
 
 void Core::removeFriend(uint32_t friendId, bool fake)
@@ -711,7 +759,7 @@ void Core::removeFriend(uint32_t friendId, bool fake)
     }
     else
     {
-        profile.saveToxSave();
+        scheduleToxSave();
         emit friendRemoved(friendId);
     }
 }
@@ -753,7 +801,7 @@ void Core::setUsername(const QString& username)
     {
         emit usernameSet(username);
         if (ready)
-            profile.saveToxSave();
+            scheduleToxSave();
     }
 }
 
@@ -828,7 +876,7 @@ void Core::setStatusMessage(const QString& message)
     else
     {
         if (ready)
-            profile.saveToxSave();
+            scheduleToxSave();
         emit statusMessageSet(message);
     }
 }
@@ -853,7 +901,7 @@ void Core::setStatus(Status status)
     }
 
     tox_self_set_status(tox, userstatus);
-    profile.saveToxSave();
+    scheduleToxSave();
     emit statusSet(status);
 }
 
@@ -1011,7 +1059,7 @@ int Core::joinGroupchat(int32_t friendnumber, uint8_t type, const uint8_t* frien
     {
         qDebug() << QString("Trying to join AV groupchat invite sent by friend %1").arg(friendnumber);
         return toxav_join_av_groupchat(tox, friendnumber, friend_group_public_key, length,
-                                       &Audio::playGroupAudioQueued, const_cast<Core*>(this));
+                                       &CoreAV::groupCallCallback, const_cast<Core*>(this));
     }
     else
     {
@@ -1038,7 +1086,7 @@ void Core::createGroup(uint8_t type)
     }
     else if (type == TOX_GROUPCHAT_TYPE_AV)
     {
-        emit emptyGroupCreated(toxav_add_av_groupchat(tox, &Audio::playGroupAudioQueued, this));
+        emit emptyGroupCreated(toxav_add_av_groupchat(tox, &CoreAV::groupCallCallback, this));
     }
     else
     {
@@ -1208,6 +1256,11 @@ void Core::killTimers(bool onlyStop)
     assert(QThread::currentThread() == coreThread);
     av->stop();
     toxTimer->stop();
+    if (saveTimer->isActive())
+    {
+        saveTimer->stop();
+        saveToxSaveNow();
+    }
     if (!onlyStop)
     {
         delete toxTimer;
@@ -1215,6 +1268,53 @@ void Core::killTimers(bool onlyStop)
     }
 }
 
+void Core::scheduleToxSave()
+{
+    if (QThread::currentThread() != coreThread)
+        return (void) QMetaObject::invokeMethod(this, "scheduleToxSave");
+
+    // Don't restart a running timer, a steady stream of changes must not postpone the save forever
+    if (!saveTimer->isActive())
+        saveTimer->start();
+}
+
+void Core::saveToxSaveNow()
+{
+    if (ready)
+        profile.saveToxSave();
+}
+
+void Core::wakeUp()
+{
+    if (QThread::currentThread() != coreThread)
+        return (void) QMetaObject::invokeMethod(this, "wakeUp");
+
+    if (!toxTimer)
+        return;
+
+    if (!sendRequested)
+    {
+        sendRequested = true;
+        sendRequestTimer.start();
+    }
+
+    // An inactive timer means we're not running, or we're inside process() and it will re-arm the timer
+    if (toxTimer->isActive() && toxTimer->remainingTime() > 0)
+    {
+        toxTimer->start(0);
+        QMutexLocker locker(&loopStatsLock);
+        ++loopStats.earlyWakeups;
+    }
+}
+
+Core::LoopStats Core::getLoopStats() const
+{
+    QMutexLocker locker(&loopStatsLock);
+    LoopStats stats = loopStats;
+    stats.elapsedMs = loopTimer.elapsed();
+    return stats;
+}
+
 void Core::reset()
 {
     assert(QThread::currentThread() == coreThread);
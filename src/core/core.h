@@ -24,6 +24,8 @@
 #include <cstdint>
 #include <QObject>
 #include <QMutex>
+#include <QElapsedTimer>
+#include <QVector>
 
 #include <tox/tox.h>
 #include <tox/toxencryptsave.h>
@@ -57,6 +59,19 @@ public:
 
     static QByteArray getSaltFromFile(QString filename);
 
+    /// Counters of the core loop, to see how long send requests wait for tox_iterate and how often we wake up
+    struct LoopStats
+    {
+        quint64 iterations = 0; ///< Calls to tox_iterate since the loop started
+        quint64 earlyWakeups = 0; ///< Iterations brought forward by a send request
+        qint64 elapsedMs = 0; ///< Time since the loop started, to turn the counters into rates
+        /// sendLatency[i] counts the send requests flushed by tox_iterate in less than latencyBuckets[i] ms,
+        /// and not in an earlier bucket. It has one extra bucket at the end for all the slower ones.
+        QVector<quint64> sendLatency;
+    };
+    static const QVector<int> latencyBuckets;
+    LoopStats getLoopStats() const; ///< Thread-safe
+
     QString getPeerName(const ToxId& id) const;
 
     QVector<uint32_t> getFriendList() const; ///< Returns the list of friendIds in our friendlist, an empty list on error
@@ -119,10 +134,14 @@ public slots:
     void sendAvatarFile(uint32_t friendId, const QByteArray& data);
     void cancelFileSend(uint32_t friendId, uint32_t fileNum);
     void cancelFileRecv(uint32_t friendId, uint32_t fileNum);
+    /// Cancels a transfer a disconnect broke, its file number may already belong to another one
+    void cancelBrokenFile(uint32_t friendId, const QByteArray& resumeFileId);
     void rejectFileRecvRequest(uint32_t friendId, uint32_t fileNum);
     void acceptFileRecvRequest(uint32_t friendId, uint32_t fileNum, QString path);
     void pauseResumeFileSend(uint32_t friendId, uint32_t fileNum);
     void pauseResumeFileRecv(uint32_t friendId, uint32_t fileNum);
+    /// Pinned transfers get most of their friend's bandwidth, ahead of small files and bulk transfers
+    void setFileSendPinned(uint32_t friendId, uint32_t fileNum, bool pinned);
 
     void setNospam(uint32_t nospam);
 
@@ -226,11 +245,24 @@ private:
 
 private slots:
     void killTimers(bool onlyStop); ///< Must only be called from the Core thread
+    /// Saves the .tox once the coalescing delay expires, so bursts of changes cost a single save
+    void scheduleToxSave();
+    void saveToxSaveNow(); ///< Hands the current .tox save to the profile's writer thread
+    /// Runs the next iteration as soon as possible, so the packets a send request queued in toxcore
+    /// go out now instead of at the end of the iteration interval. Thread-safe.
+    void wakeUp();
 
 private:
     Tox* tox;
     CoreAV* av;
     QTimer *toxTimer;
+    QTimer *saveTimer;
+    QElapsedTimer loopTimer; ///< Started with the loop, for the stats
+    QElapsedTimer sendRequestTimer; ///< Started by the oldest send request not yet flushed by tox_iterate
+    bool sendRequested = false;
+    mutable QMutex loopStatsLock;
+    LoopStats loopStats;
+    static constexpr int saveDelay = 1000; ///< Milliseconds during which .tox save requests are coalesced
     Profile& profile;
     QMutex messageSendMutex;
     bool ready;
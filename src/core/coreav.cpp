@@ -21,12 +21,14 @@
 #include "core.h"
 #include "coreav.h"
 #include "src/audio/audio.h"
+#include "src/audio/audiomixer.h"
 #include "src/persistence/settings.h"
 #include "src/video/videoframe.h"
 #include "src/video/corevideosource.h"
 #include <cassert>
 #include <QThread>
 #include <QTimer>
+#include <QDateTime>
 #include <QDebug>
 #include <QCoreApplication>
 #include <QtConcurrent/QtConcurrentRun>
@@ -37,6 +39,7 @@
 
 IndexedList<ToxFriendCall> CoreAV::calls;
 IndexedList<ToxGroupCall> CoreAV::groupCalls;
+QMutex CoreAV::groupCallsLock;
 
 using namespace std;
 
@@ -107,7 +110,15 @@ void CoreAV::killTimerFromThread()
 void CoreAV::process()
 {
     toxav_iterate(toxav);
-    iterateTimer->start(toxav_iteration_interval(toxav));
+    // Invites arrive through tox_iterate, so without calls there is nothing to do here but wait for one
+    iterateTimer->start(calls.isEmpty() ? idleIterationInterval : toxav_iteration_interval(toxav));
+}
+
+void CoreAV::wakeUp()
+{
+    assert(QThread::currentThread() == coreavThread.get());
+    if (iterateTimer && iterateTimer->isActive())
+        iterateTimer->start(0);
 }
 
 bool CoreAV::anyActiveCalls()
@@ -187,6 +198,7 @@ bool CoreAV::startCall(uint32_t friendNum, bool video)
 
     auto call = calls.insert({friendNum, video, *this});
     call->startTimeout();
+    wakeUp();
     return true;
 }
 
@@ -311,15 +323,21 @@ void CoreAV::sendCallVideo(uint32_t callId, shared_ptr<VideoFrame> vframe)
             || !(call.state & TOXAV_FRIEND_CALL_STATE_ACCEPTING_V))
         return;
 
+    VideoRateController& rateControl = *call.rateControl;
+
     if (call.nullVideoBitrate)
     {
+        // Pick up where we left, the link didn't get any faster while we weren't sending
         qDebug() << "Restarting video stream to friend"<<callId;
-        toxav_bit_rate_set(toxav, call.callId, -1, VIDEO_DEFAULT_BITRATE, nullptr);
+        toxav_bit_rate_set(toxav, call.callId, -1, rateControl.getBitrate(), nullptr);
         call.nullVideoBitrate = false;
     }
 
+    if (!rateControl.shouldSendFrame())
+        return;
+
     // This frame shares vframe's buffers, we don't call vpx_img_free but just delete it
-    vpx_image* frame = vframe->toVpxImage();
+    vpx_image* frame = vframe->toVpxImage(rateControl.getFrameSize(vframe->getSize()));
     if (frame->fmt == VPX_IMG_FMT_NONE)
     {
         qWarning() << "Invalid frame";
@@ -349,9 +367,24 @@ void CoreAV::sendCallVideo(uint32_t callId, shared_ptr<VideoFrame> vframe)
     if (err == TOXAV_ERR_SEND_FRAME_SYNC)
         qDebug() << "toxav_video_send_frame error: Lock busy, dropping frame";
 
+    bool sent = err == TOXAV_ERR_SEND_FRAME_OK;
+    if (rateControl.reportFrame(sent, {(int)frame->d_w, (int)frame->d_h}, QDateTime::currentMSecsSinceEpoch()))
+    {
+        qDebug() << "Video bitrate to friend"<<callId<<"is now"<<rateControl.getBitrate();
+        toxav_bit_rate_set(toxav, call.callId, -1, rateControl.getBitrate(), nullptr);
+    }
+
     delete frame;
 }
 
+VideoRateController::Stats CoreAV::getCallVideoStats(uint32_t friendNum)
+{
+    if (!calls.contains(friendNum) || !calls[friendNum].rateControl)
+        return VideoRateController::Stats{};
+
+    return calls[friendNum].rateControl->getStats();
+}
+
 void CoreAV::micMuteToggle(uint32_t callId)
 {
     if (calls.contains(callId))
@@ -379,6 +412,7 @@ void CoreAV::joinGroupCall(int groupId)
 {
     qDebug() << QString("Joining group call %1").arg(groupId);
 
+    QMutexLocker locker{&groupCallsLock};
     auto call = groupCalls.insert({groupId, *this});
     call->inactive = false;
 }
@@ -387,17 +421,23 @@ void CoreAV::leaveGroupCall(int groupId)
 {
     qDebug() << QString("Leaving group call %1").arg(groupId);
 
+    QMutexLocker locker{&groupCallsLock};
     groupCalls.remove(groupId);
 }
 
 bool CoreAV::sendGroupCallAudio(int groupId, const int16_t *pcm, size_t samples, uint8_t chans, uint32_t rate)
 {
-    if (!groupCalls.contains(groupId))
-        return false;
+    {
+        QMutexLocker locker{&groupCallsLock};
+        if (!groupCalls.contains(groupId))
+            return false;
 
-    ToxGroupCall& call = groupCalls[groupId];
+        ToxGroupCall& call = groupCalls[groupId];
+        if (call.inactive || call.muteMic)
+            return true;
+    }
 
-    if (call.inactive || call.muteMic || !Audio::getInstance().isInputReady())
+    if (!Audio::getInstance().isInputReady())
         return true;
 
 
@@ -409,31 +449,37 @@ bool CoreAV::sendGroupCallAudio(int groupId, const int16_t *pcm, size_t samples,
 
 void CoreAV::disableGroupCallMic(int groupId)
 {
+    QMutexLocker locker{&groupCallsLock};
     groupCalls[groupId].muteMic = true;
 }
 
 void CoreAV::disableGroupCallVol(int groupId)
 {
+    QMutexLocker locker{&groupCallsLock};
     groupCalls[groupId].muteVol = true;
 }
 
 void CoreAV::enableGroupCallMic(int groupId)
 {
+    QMutexLocker locker{&groupCallsLock};
     groupCalls[groupId].muteMic = false;
 }
 
 void CoreAV::enableGroupCallVol(int groupId)
 {
+    QMutexLocker locker{&groupCallsLock};
     groupCalls[groupId].muteVol = false;
 }
 
 bool CoreAV::isGroupCallMicEnabled(int groupId) const
 {
+    QMutexLocker locker{&groupCallsLock};
     return !groupCalls[groupId].muteMic;
 }
 
 bool CoreAV::isGroupCallVolEnabled(int groupId) const
 {
+    QMutexLocker locker{&groupCallsLock};
     return !groupCalls[groupId].muteVol;
 }
 
@@ -442,17 +488,26 @@ bool CoreAV::isGroupAvEnabled(int groupId) const
     return tox_group_get_type(Core::getInstance()->tox, groupId) == TOX_GROUPCHAT_TYPE_AV;
 }
 
-void CoreAV::invalidateCallSources()
+void CoreAV::groupCallCallback(void*, int group, int peer, const int16_t* data,
+                               unsigned samples, uint8_t channels, unsigned sampleRate, void* core)
 {
-    for (ToxGroupCall& call : groupCalls)
-    {
-        call.alSource = 0;
-    }
+    emit static_cast<Core*>(core)->groupPeerAudioPlaying(group, peer);
 
-    for (ToxFriendCall& call : calls)
+    int stream;
     {
-        call.alSource = 0;
+        // Only held to read the call, the mixer has its own locking
+        QMutexLocker locker{&groupCallsLock};
+        if (!groupCalls.contains(group))
+            return;
+
+        const ToxGroupCall& call = groupCalls[group];
+        if (call.inactive || call.muteVol)
+            return;
+
+        stream = call.mixerStream;
     }
+
+    AudioMixer::getInstance().pushFrame(stream, peer, data, samples, channels, sampleRate);
 }
 
 void CoreAV::sendNoVideo()
@@ -498,6 +553,7 @@ void CoreAV::callCallback(ToxAV* toxav, uint32_t friendNum, bool audio, bool vid
     }
     qDebug() << QString("Received call invite from %1").arg(friendNum);
     const auto& callIt = self->calls.insert({friendNum, video, *self});
+    self->wakeUp();
 
     // We don't get a state callback when answering, so fill the state ourselves in advance
     int state = 0;
@@ -595,7 +651,12 @@ void CoreAV::bitrateCallback(ToxAV* toxav, uint32_t friendNum, uint32_t arate, u
                                                 Q_ARG(uint32_t, arate), Q_ARG(uint32_t, vrate), Q_ARG(void*, _self));
     }
 
-    qDebug() << "Recommended bitrate with"<<friendNum<<" is now "<<arate<<"/"<<vrate<<", ignoring it";
+    qDebug() << "Recommended bitrate with"<<friendNum<<" is now "<<arate<<"/"<<vrate;
+
+    // We keep our audio bitrate, Opus at 64kb/s is cheap next to any video
+    if (!self->calls.contains(friendNum) || !self->calls[friendNum].rateControl)
+        return;
+    self->calls[friendNum].rateControl->setRecommendedBitrate(vrate);
 }
 
 void CoreAV::audioFrameCallback(ToxAV *, uint32_t friendNum, const int16_t *pcm,
@@ -610,11 +671,7 @@ void CoreAV::audioFrameCallback(ToxAV *, uint32_t friendNum, const int16_t *pcm,
     if (call.muteVol)
         return;
 
-    Audio& audio = Audio::getInstance();
-    if (!call.alSource)
-        audio.subscribeOutput(call.alSource);
-
-    audio.playAudioBuffer(call.alSource, pcm, sampleCount, channels, samplingRate);
+    AudioMixer::getInstance().pushFrame(call.mixerStream, 0, pcm, sampleCount, channels, samplingRate);
 }
 
 void CoreAV::videoFrameCallback(ToxAV *, uint32_t friendNum, uint16_t w, uint16_t h,
@@ -22,6 +22,7 @@
 #define COREAV_H
 
 #include <QObject>
+#include <QMutex>
 #include <memory>
 #include <atomic>
 #include "src/core/toxcall.h"
@@ -55,10 +56,12 @@ public:
     /// Returns false only on error, but not if there's nothing to send
     bool sendCallAudio(uint32_t friendNum, const int16_t *pcm, size_t samples, uint8_t chans, uint32_t rate);
     void sendCallVideo(uint32_t friendNum, std::shared_ptr<VideoFrame> frame);
+    /// Returns the bitrate, frame rate and drops of the video we send in this call
+    /// The stats are all zero if there is no such call or we don't send video in it
+    VideoRateController::Stats getCallVideoStats(uint32_t friendNum);
     bool sendGroupCallAudio(int groupNum, const int16_t *pcm, size_t samples, uint8_t chans, uint32_t rate);
 
     VideoSource* getVideoSourceFromCall(int callNumber); ///< Get a call's video source
-    void invalidateCallSources(); ///< Forces to regenerate each call's audio sources
     void sendNoVideo(); ///< Signal to all peers that we're not sending video anymore. The next frame sent cancels this.
 
     void joinGroupCall(int groupNum); ///< Starts a call in an existing AV groupchat. Call from the GUI thread.
@@ -70,6 +73,10 @@ public:
     bool isGroupCallMicEnabled(int groupNum) const;
     bool isGroupCallVolEnabled(int groupNum) const;
     bool isGroupAvEnabled(int groupNum) const; ///< True for AV groups, false for text-only groups
+    /// Called by toxcore from the core thread with a frame of a group peer's audio
+    /// The first argument is ignored, the last one is our Core
+    static void groupCallCallback(void*, int group, int peer, const int16_t* data,
+                                  unsigned samples, uint8_t channels, unsigned sampleRate, void* core);
 
     void micMuteToggle(uint32_t friendNum);
     void volMuteToggle(uint32_t friendNum);
@@ -97,6 +104,8 @@ private slots:
 
 private:
     void process();
+    /// Switches from the idle interval back to iterating at toxav's pace, when a call starts
+    void wakeUp();
     static void audioFrameCallback(ToxAV *toxAV, uint32_t friendNum, const int16_t *pcm, size_t sampleCount,
                                   uint8_t channels, uint32_t samplingRate, void* self);
     static void videoFrameCallback(ToxAV *toxAV, uint32_t friendNum, uint16_t w, uint16_t h,
@@ -106,6 +115,7 @@ private:
 private:
     static constexpr uint32_t AUDIO_DEFAULT_BITRATE = 64; ///< In kb/s. More than enough for Opus.
     static constexpr uint32_t VIDEO_DEFAULT_BITRATE = 6144; ///< Picked at random by fair dice roll.
+    static constexpr int idleIterationInterval = 1000; ///< In ms, how often we iterate toxav without calls
 
 private:
     ToxAV* toxav;
@@ -113,6 +123,8 @@ private:
     std::unique_ptr<QTimer> iterateTimer;
     static IndexedList<ToxFriendCall> calls;
     static IndexedList<ToxGroupCall> groupCalls; // Maps group IDs to ToxGroupCalls
+    /// Protects groupCalls, which the GUI changes while toxcore's thread plays their audio
+    static QMutex groupCallsLock;
     /**
      * This flag is to be acquired before switching in a blocking way between the UI and CoreAV thread.
      * The CoreAV thread must have priority for the flag, other threads should back off or release it quickly.
@@ -128,6 +140,7 @@ private:
     std::atomic_flag threadSwitchLock;
 
     friend class Audio;
+    friend struct ToxFriendCall;
 };
 
 #endif // COREAV_H
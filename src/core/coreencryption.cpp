@@ -28,6 +28,7 @@
 #include "src/nexus.h"
 #include "src/persistence/profile.h"
 #include "src/persistence/historykeeper.h"
+#include "src/persistence/passkeycache.h"
 #include <tox/tox.h>
 #include <tox/toxencryptsave.h>
 #include <QApplication>
@@ -128,7 +129,8 @@ void Core::checkEncryptedHistory()
         return;
     }
 
-    auto passkey = createPasskey(Nexus::getProfile()->getPassword(), reinterpret_cast<uint8_t*>(salt.data()));
+    TOX_PASS_KEY passkey = PasskeyCache::getKey(Nexus::getProfile()->getPassword(),
+                                                reinterpret_cast<uint8_t*>(salt.data()));
 
     QString a(tr("Please enter the password for the chat history for the profile \"%1\".", "used in load() when no hist pw set").arg(Nexus::getProfile()->getName()));
     QString b(tr("The previous password is incorrect; please try again:", "used on retries in load()"));
@@ -136,7 +138,7 @@ void Core::checkEncryptedHistory()
     QString dialogtxt;
 
 
-    if (!exists || HistoryKeeper::checkPassword(*passkey))
+    if (!exists || HistoryKeeper::checkPassword(passkey))
         return;
 
     dialogtxt = tr("The chat history password failed. Please try another?", "used only when pw set before load() doesn't work");
@@ -154,10 +156,10 @@ void Core::checkEncryptedHistory()
         }
         else
         {
-            passkey = createPasskey(pw, reinterpret_cast<uint8_t*>(salt.data()));
+            passkey = PasskeyCache::getKey(pw, reinterpret_cast<uint8_t*>(salt.data()));
         }
 
-        error = exists && !HistoryKeeper::checkPassword(*passkey);
+        error = exists && !HistoryKeeper::checkPassword(passkey);
         dialogtxt = a + "\n" + c + "\n" + b;
     } while (error);
 }
@@ -21,6 +21,8 @@
 #include "core.h"
 #include "corefile.h"
 #include "corestructs.h"
+#include "filereadahead.h"
+#include "filewritebehind.h"
 #include "src/core/cstring.h"
 #include "src/persistence/settings.h"
 #include "src/persistence/profile.h"
@@ -28,29 +30,63 @@
 #include <QFile>
 #include <QThread>
 #include <QDir>
+#include <QDateTime>
 #include <memory>
+#include <algorithm>
+#include <QMap>
 
 QMutex CoreFile::fileSendMutex;
 QHash<uint64_t, ToxFile> CoreFile::fileMap;
+QHash<QByteArray, ToxFile> CoreFile::brokenFiles;
+QHash<uint64_t, QQueue<QPair<uint64_t, size_t>>> CoreFile::pendingChunks;
+QByteArray CoreFile::chunkBuffer;
+QHash<uint64_t, qint64> CoreFile::deficits;
+uint32_t CoreFile::lastServedFriend{0};
+unsigned CoreFile::chunkRequests{0};
+bool CoreFile::fileStatesChanged{true};
+unsigned CoreFile::transferInterval{0};
+qint64 CoreFile::lastBrokenExpiry{0};
 using namespace std;
 
 unsigned CoreFile::corefileIterationInterval()
 {
     /// Sleep at most 1000ms if we have no FT, 10 for user FTs, 50 for the rest (avatars, ...)
-    constexpr unsigned fastFileInterval=10, slowFileInterval=50, idleInterval=1000;
-    unsigned interval = idleInterval;
+    /// and only 2 while toxcore keeps asking for chunks or we have chunks left to send
+    constexpr unsigned busyFileInterval=2, fastFileInterval=10, slowFileInterval=50, idleInterval=1000;
 
-    for (ToxFile& file : fileMap)
+    unsigned requests = chunkRequests;
+    chunkRequests = 0;
+    if (requests > busyChunkRequests)
+        return busyFileInterval;
+
+    // Paused transfers keep their queued chunks, toxcore won't ask for them again,
+    // but there's nothing to send until they resume
+    for (auto it = pendingChunks.constBegin(); it != pendingChunks.constEnd(); ++it)
     {
-        if (file.status == ToxFile::TRANSMITTING)
+        auto file = fileMap.constFind(it.key());
+        if (file != fileMap.constEnd() && file->status == ToxFile::TRANSMITTING)
+            return busyFileInterval;
+    }
+
+    // The transfers only need a rescan when one was added, removed, paused or resumed
+    if (fileStatesChanged)
+    {
+        fileStatesChanged = false;
+        transferInterval = idleInterval;
+        for (ToxFile& file : fileMap)
         {
+            if (file.status != ToxFile::TRANSMITTING)
+                continue;
+
             if (file.fileKind == TOX_FILE_KIND_DATA)
-                return fastFileInterval;
-            else
-                interval = slowFileInterval;
+            {
+                transferInterval = fastFileInterval;
+                break;
+            }
+            transferInterval = slowFileInterval;
         }
     }
-    return interval;
+    return transferInterval;
 }
 
 void CoreFile::sendAvatarFile(Core* core, uint32_t friendId, const QByteArray& data)
@@ -112,6 +148,7 @@ void CoreFile::sendFile(Core* core, uint32_t friendId, QString Filename, QString
     {
         qWarning() << QString("sendFile: Can't open file, error: %1").arg(file.file->errorString());
     }
+    file.readAhead = std::make_shared<FileReadAhead>(FilePath);
     addFile(friendId, fileNum, file);
 
     emit core->fileSendStarted(file);
@@ -128,12 +165,14 @@ void CoreFile::pauseResumeFileSend(Core* core, uint32_t friendId, uint32_t fileI
     if (file->status == ToxFile::TRANSMITTING)
     {
         file->status = ToxFile::PAUSED;
+        fileStatesChanged = true;
         emit core->fileTransferPaused(*file);
         tox_file_control(core->tox, file->friendId, file->fileNum, TOX_FILE_CONTROL_PAUSE, nullptr);
     }
     else if (file->status == ToxFile::PAUSED)
     {
         file->status = ToxFile::TRANSMITTING;
+        fileStatesChanged = true;
         emit core->fileTransferAccepted(*file);
         tox_file_control(core->tox, file->friendId, file->fileNum, TOX_FILE_CONTROL_RESUME, nullptr);
     }
@@ -152,12 +191,14 @@ void CoreFile::pauseResumeFileRecv(Core* core, uint32_t friendId, uint32_t fileI
     if (file->status == ToxFile::TRANSMITTING)
     {
         file->status = ToxFile::PAUSED;
+        fileStatesChanged = true;
         emit core->fileTransferPaused(*file);
         tox_file_control(core->tox, file->friendId, file->fileNum, TOX_FILE_CONTROL_PAUSE, nullptr);
     }
     else if (file->status == ToxFile::PAUSED)
     {
         file->status = ToxFile::TRANSMITTING;
+        fileStatesChanged = true;
         emit core->fileTransferAccepted(*file);
         tox_file_control(core->tox, file->friendId, file->fileNum, TOX_FILE_CONTROL_RESUME, nullptr);
     }
@@ -165,6 +206,17 @@ void CoreFile::pauseResumeFileRecv(Core* core, uint32_t friendId, uint32_t fileI
         qWarning() << "pauseResumeFileRecv: File is stopped or broken";
 }
 
+void CoreFile::setFileSendPinned(uint32_t friendId, uint32_t fileId, bool pinned)
+{
+    ToxFile* file = findFile(friendId, fileId);
+    if (!file)
+    {
+        qWarning("setFileSendPinned: No such file in queue");
+        return;
+    }
+    file->pinned = pinned;
+}
+
 void CoreFile::cancelFileSend(Core* core, uint32_t friendId, uint32_t fileId)
 {
     ToxFile* file = findFile(friendId, fileId);
@@ -221,7 +273,13 @@ void CoreFile::acceptFileRecvRequest(Core* core, uint32_t friendId, uint32_t fil
         qWarning() << "acceptFileRecvRequest: Unable to open file";
         return;
     }
+    // Reserve the space now rather than grow the file a chunk at a time,
+    // and find out right away if it doesn't fit
+    if (!file->file->resize(file->filesize))
+        qWarning() << "acceptFileRecvRequest: Unable to preallocate"<<file->filesize<<"bytes:"<<file->file->errorString();
+    file->writeBehind = std::make_shared<FileWriteBehind>(file->file);
     file->status = ToxFile::TRANSMITTING;
+    fileStatesChanged = true;
     emit core->fileTransferAccepted(*file);
     tox_file_control(core->tox, file->friendId, file->fileNum, TOX_FILE_CONTROL_RESUME, nullptr);
 }
@@ -244,6 +302,7 @@ void CoreFile::addFile(uint32_t friendId, uint32_t fileId, const ToxFile& file)
     if (fileMap.contains(key))
         qWarning() << "addFile: Overwriting existing file transfer with same ID "<<friendId<<':'<<fileId;
     fileMap.insert(key, file);
+    fileStatesChanged = true;
 }
 
 void CoreFile::removeFile(uint32_t friendId, uint32_t fileId)
@@ -254,8 +313,24 @@ void CoreFile::removeFile(uint32_t friendId, uint32_t fileId)
         qWarning() << "removeFile: No such file in queue";
         return;
     }
-    fileMap[key].file->close();
+    closeFile(fileMap[key]);
     fileMap.remove(key);
+    fileStatesChanged = true;
+    pendingChunks.remove(key);
+    deficits.remove(key);
+}
+
+void CoreFile::closeFile(ToxFile& file)
+{
+    if (file.writeBehind)
+    {
+        // Don't leave the preallocated space of an unfinished file behind
+        file.writeBehind->close();
+        file.file->resize(file.file->pos());
+    }
+    file.file->close();
+    if (file.readAhead)
+        file.readAhead->close();
 }
 
 void CoreFile::onFileReceiveCallback(Tox*, uint32_t friendId, uint32_t fileId, uint32_t kind,
@@ -298,6 +373,15 @@ void CoreFile::onFileReceiveCallback(Tox*, uint32_t friendId, uint32_t fileId, u
     {
         qDebug() << QString("Received file request %1:%2 kind %3")
                             .arg(friendId).arg(fileId).arg(kind);
+
+        QByteArray resumeFileId(TOX_FILE_ID_LENGTH, 0);
+        tox_file_get_file_id(core->tox, friendId, fileId, (uint8_t*)resumeFileId.data(), nullptr);
+        QByteArray brokenKey = getBrokenFileKey(friendId, resumeFileId);
+        if (brokenFiles.contains(brokenKey))
+        {
+            resumeBrokenRecv(core, friendId, fileId, brokenFiles.take(brokenKey));
+            return;
+        }
     }
 
     ToxFile file{fileId, friendId, QByteArray((char*)fname,fnameLen), "", ToxFile::RECEIVING};
@@ -330,6 +414,7 @@ void CoreFile::onFileControlCallback(Tox*, uint32_t friendId, uint32_t fileId,
     {
         qDebug() << "onFileControlCallback: Received pause for file "<<friendId<<":"<<fileId;
         file->status = ToxFile::PAUSED;
+        fileStatesChanged = true;
         emit static_cast<Core*>(core)->fileTransferRemotePausedUnpaused(*file, true);
     }
     else if (control == TOX_FILE_CONTROL_RESUME)
@@ -339,6 +424,7 @@ void CoreFile::onFileControlCallback(Tox*, uint32_t friendId, uint32_t fileId,
         else
             qDebug() << "onFileControlCallback: Received resume for file "<<friendId<<":"<<fileId;
         file->status = ToxFile::TRANSMITTING;
+        fileStatesChanged = true;
         emit static_cast<Core*>(core)->fileTransferRemotePausedUnpaused(*file, false);
     }
     else
@@ -372,37 +458,174 @@ void CoreFile::onFileDataCallback(Tox *tox, uint32_t friendId, uint32_t fileId,
         return;
     }
 
-    unique_ptr<uint8_t[]> data(new uint8_t[length]);
-    int64_t nread;
-
     if (file->fileKind == TOX_FILE_KIND_AVATAR)
     {
-        QByteArray chunk = file->avatarData.mid(pos, length);
-        nread = chunk.size();
-        memcpy(data.get(), chunk.data(), nread);
+        qint64 nread = qBound<qint64>(0, file->avatarData.size() - (qint64)pos, length);
+        if (!tox_file_send_chunk(tox, friendId, fileId, pos,
+                                 (const uint8_t*)file->avatarData.constData() + pos, nread, nullptr))
+            qWarning("onFileDataCallback: Failed to send data chunk");
+        return;
     }
-    else
+
+    // Never wait for the disk here, we're blocking every other transfer and message
+    // The chunks are sent from Core's loop right after this iteration, in scheduling order
+    uint64_t key = ((uint64_t)friendId<<32) + (uint64_t)fileId;
+    pendingChunks[key].enqueue({pos, length});
+    ++chunkRequests;
+}
+
+void CoreFile::sendPendingChunks(Core* core)
+{
+    QMap<uint32_t, QList<uint64_t>> friendTransfers;
+    for (uint64_t key : pendingChunks.keys())
     {
-        file->file->seek(pos);
-        nread = file->file->read((char*)data.get(), length);
-        if (nread <= 0)
+        auto it = fileMap.find(key);
+        if (it == fileMap.end())
         {
-            qWarning("onFileDataCallback: Failed to read from file");
-            emit static_cast<Core*>(core)->fileTransferCancelled(*file);
-            tox_file_send_chunk(tox, friendId, fileId, pos, nullptr, 0, nullptr);
-            removeFile(friendId, fileId);
-            return;
+            pendingChunks.remove(key);
+            deficits.remove(key);
+            continue;
         }
-        file->bytesSent += length;
+        if (it->status == ToxFile::TRANSMITTING)
+            friendTransfers[key>>32].append(key);
     }
+    if (friendTransfers.isEmpty())
+        return;
 
-    if (!tox_file_send_chunk(tox, friendId, fileId, pos, data.get(), nread, nullptr))
+    // Friends take turns going first, each one gets an even share of what's left of the budget
+    QList<uint32_t> friends = friendTransfers.keys();
+    int first = 0;
+    while (first < friends.size() && friends[first] <= lastServedFriend)
+        ++first;
+    std::rotate(friends.begin(), friends.begin() + (first % friends.size()), friends.end());
+
+    qint64 globalBudget = maxBytesPerIteration;
+    int friendsLeft = friends.size();
+    for (uint32_t friendId : friends)
     {
-        qWarning("onFileDataCallback: Failed to send data chunk");
-        return;
+        qint64 friendBudget = globalBudget / friendsLeft--;
+        QList<uint64_t>& keys = friendTransfers[friendId];
+        std::stable_sort(keys.begin(), keys.end(), [](uint64_t a, uint64_t b)
+        {
+            return getTransferWeight(fileMap[a]) > getTransferWeight(fileMap[b]);
+        });
+
+        // Deficit round robin between the transfers of this friend, until the budget is spent,
+        // toxcore's queue is full, or no transfer has anything ready to send
+        qint64 spent = 0;
+        bool sendqFull = false, progress = true;
+        while (progress && !sendqFull && spent < friendBudget)
+        {
+            progress = false;
+            for (uint64_t key : keys)
+            {
+                if (!pendingChunks.contains(key))
+                    continue;
+
+                ToxFile& file = fileMap[key];
+                qint64 quantum = quantumBytes * getTransferWeight(file);
+                // Don't let a transfer waiting for the disk save up a burst
+                qint64& deficit = deficits[key];
+                deficit = qMin(deficit + quantum, 4 * quantum);
+
+                qint64 sent = sendQueuedChunks(core, file, qMin(deficit, friendBudget - spent), sendqFull);
+                if (sent < 0 || !pendingChunks.contains(key))
+                {
+                    deficits.remove(key);
+                }
+                else
+                {
+                    deficits[key] -= sent;
+                }
+                if (sent > 0)
+                {
+                    spent += sent;
+                    progress = true;
+                }
+                if (sendqFull || spent >= friendBudget)
+                    break;
+            }
+        }
+
+        globalBudget -= spent;
+        lastServedFriend = friendId;
+    }
+}
+
+int CoreFile::getTransferWeight(const ToxFile& file)
+{
+    if (file.pinned)
+        return 16;
+    else if (file.filesize <= smallFileSize)
+        return 4;
+    else
+        return 1;
+}
+
+qint64 CoreFile::sendQueuedChunks(Core* core, ToxFile& file, qint64 budget, bool& sendqFull)
+{
+    uint64_t key = ((uint64_t)file.friendId<<32) + (uint64_t)file.fileNum;
+    QQueue<QPair<uint64_t, size_t>>& queue = pendingChunks[key];
+    qint64 sent = 0;
+
+    while (!queue.isEmpty())
+    {
+        uint64_t pos = queue.head().first;
+        size_t length = queue.head().second;
+        if ((qint64)length > budget - sent)
+            break;
+        if (chunkBuffer.size() < (int)length)
+            chunkBuffer.resize(length);
+
+        qint64 nread = file.readAhead->read(pos, chunkBuffer.data(), length);
+        if (nread < 0)
+        {
+            qWarning("sendQueuedChunks: Failed to read from file");
+            emit core->fileTransferCancelled(file);
+            tox_file_send_chunk(core->tox, file.friendId, file.fileNum, pos, nullptr, 0, nullptr);
+            removeFile(file.friendId, file.fileNum);
+            return -1;
+        }
+        if (nread == 0)
+            break;
+
+        TOX_ERR_FILE_SEND_CHUNK err;
+        if (!tox_file_send_chunk(core->tox, file.friendId, file.fileNum, pos,
+                                 (const uint8_t*)chunkBuffer.constData(), nread, &err))
+        {
+            // A full send queue empties as toxcore iterates, try again then
+            if (err == TOX_ERR_FILE_SEND_CHUNK_SENDQ)
+            {
+                sendqFull = true;
+                break;
+            }
+            qWarning() << "sendQueuedChunks: Failed to send data chunk, error"<<err;
+        }
+        else
+        {
+            // Chunks don't start at 0 when the receiver resumes a broken transfer
+            file.bytesSent = pos + nread;
+            sent += nread;
+        }
+        queue.dequeue();
     }
-    if (file->fileKind != TOX_FILE_KIND_AVATAR)
-        emit static_cast<Core*>(core)->fileTransferInfo(*file);
+
+    if (queue.isEmpty())
+        pendingChunks.remove(key);
+    if (sent)
+        reportProgress(core, file);
+    return sent;
+}
+
+void CoreFile::reportProgress(Core* core, ToxFile& file)
+{
+    // Every signal copies the ToxFile to the GUI thread, a fast transfer would flood its event queue
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now - file.progressTimestamp < progressInterval)
+        return;
+
+    file.progressTimestamp = now;
+    emit core->fileTransferInfo(file);
 }
 
 void CoreFile::onFileRecvChunkCallback(Tox *tox, uint32_t friendId, uint32_t fileId, uint64_t position,
@@ -445,6 +668,8 @@ void CoreFile::onFileRecvChunkCallback(Tox *tox, uint32_t friendId, uint32_t fil
         }
         else
         {
+            if (!file->writeBehind->flush())
+                qWarning() << "onFileRecvChunkCallback: Failed to write the end of"<<file->filePath;
             emit core->fileTransferFinished(*file);
             emit core->fileDownloadFinished(file->filePath);
         }
@@ -453,29 +678,156 @@ void CoreFile::onFileRecvChunkCallback(Tox *tox, uint32_t friendId, uint32_t fil
     }
 
     if (file->fileKind == TOX_FILE_KIND_AVATAR)
+    {
         file->avatarData.append((char*)data, length);
-    else
-        file->file->write((char*)data,length);
+        file->bytesSent += length;
+        return;
+    }
+
+    if (!file->writeBehind->append((const char*)data, length))
+    {
+        qWarning("onFileRecvChunkCallback: Failed to write to file, aborting transfer");
+        emit core->fileTransferCancelled(*file);
+        tox_file_control(tox, friendId, fileId, TOX_FILE_CONTROL_CANCEL, nullptr);
+        removeFile(friendId, fileId);
+        return;
+    }
     file->bytesSent += length;
 
-    if (file->fileKind != TOX_FILE_KIND_AVATAR)
-        emit static_cast<Core*>(core)->fileTransferInfo(*file);
+    reportProgress(core, *file);
 }
 
 void CoreFile::onConnectionStatusChanged(Core* core, uint32_t friendId, bool online)
 {
-    /// TODO: Actually resume broken file transfers
-    /// We need to:
-    /// - Start a new file transfer with the same 32byte file ID with toxcore
-    /// - Seek to the correct position again
-    /// - Update the fileNum in our ToxFile
-    /// - Update the users of our signals to check the 32byte tox file ID, not the uint32_t file_num (fileId)
-    ToxFile::FileStatus status = online ? ToxFile::TRANSMITTING : ToxFile::BROKEN;
-    for (uint64_t key : fileMap.keys())
-    {
-        if (key>>32 != friendId)
+    if (!online)
+    {
+        // toxcore drops all transfers with a friend that goes offline and will reuse their numbers,
+        // we keep ours aside by file ID until the friend comes back
+        for (uint64_t key : fileMap.keys())
+        {
+            if (key>>32 != friendId)
+                continue;
+
+            ToxFile file = fileMap.take(key);
+            fileStatesChanged = true;
+            pendingChunks.remove(key);
+            deficits.remove(key);
+            if (file.fileKind == TOX_FILE_KIND_AVATAR)
+            {
+                // Avatars are broadcast again when the friend comes back
+                closeFile(file);
+                continue;
+            }
+
+            file.status = ToxFile::BROKEN;
+            file.brokenTimestamp = QDateTime::currentMSecsSinceEpoch();
+            emit core->fileTransferBrokenUnbroken(file, true);
+            brokenFiles.insert(getBrokenFileKey(friendId, file.resumeFileId), file);
+        }
+        return;
+    }
+
+    // We offer our transfers again with the same file ID, the receiver recognizes them
+    // and seeks to what it already has. Receiving transfers wait for the sender to do the same.
+    for (const QByteArray& brokenKey : brokenFiles.keys())
+    {
+        ToxFile& file = brokenFiles[brokenKey];
+        if (file.friendId != friendId || file.direction != ToxFile::SENDING)
+            continue;
+
+        TOX_ERR_FILE_SEND err;
+        uint32_t fileNum = tox_file_send(core->tox, friendId, TOX_FILE_KIND_DATA, file.filesize,
+                                         (const uint8_t*)file.resumeFileId.constData(),
+                                         (const uint8_t*)file.fileName.constData(), file.fileName.size(), &err);
+        if (fileNum == std::numeric_limits<uint32_t>::max())
+        {
+            qWarning() << "onConnectionStatusChanged: Can't offer broken transfer again, error"<<err;
+            file.status = ToxFile::STOPPED;
+            emit core->fileTransferCancelled(file);
+            closeFile(file);
+            brokenFiles.remove(brokenKey);
             continue;
-        fileMap[key].status = status;
-        emit core->fileTransferBrokenUnbroken(fileMap[key], !online);
+        }
+
+        qDebug() << "Offering broken transfer"<<friendId<<":"<<file.fileNum<<"again as"<<fileNum;
+        ToxFile resumed = brokenFiles.take(brokenKey);
+        resumed.fileNum = fileNum;
+        resumed.status = ToxFile::STOPPED;
+        addFile(friendId, fileNum, resumed);
+        emit core->fileTransferBrokenUnbroken(resumed, false);
     }
 }
+
+QByteArray CoreFile::getBrokenFileKey(uint32_t friendId, const QByteArray& resumeFileId)
+{
+    return QByteArray((const char*)&friendId, sizeof(friendId)) + resumeFileId;
+}
+
+void CoreFile::cancelBrokenFile(Core* core, uint32_t friendId, const QByteArray& resumeFileId)
+{
+    QByteArray brokenKey = getBrokenFileKey(friendId, resumeFileId);
+    if (!brokenFiles.contains(brokenKey))
+    {
+        qWarning("cancelBrokenFile: No such broken transfer");
+        return;
+    }
+
+    // toxcore already forgot this transfer, there's no one to notify
+    ToxFile file = brokenFiles.take(brokenKey);
+    file.status = ToxFile::STOPPED;
+    emit core->fileTransferCancelled(file);
+    closeFile(file);
+}
+
+void CoreFile::expireBrokenFiles(Core* core)
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (brokenFiles.isEmpty() || now - lastBrokenExpiry < brokenExpiryInterval)
+        return;
+
+    lastBrokenExpiry = now;
+
+    // Our own transfers are offered again when the friend comes back,
+    // but nothing tells us a sender won't ever offer theirs again
+    for (const QByteArray& brokenKey : brokenFiles.keys())
+    {
+        const ToxFile& file = brokenFiles[brokenKey];
+        if (file.direction != ToxFile::RECEIVING || now - file.brokenTimestamp < brokenRecvTimeout)
+            continue;
+
+        qDebug() << "Giving up on broken transfer"<<file.friendId<<":"<<file.fileNum;
+        cancelBrokenFile(core, file.friendId, file.resumeFileId);
+    }
+}
+
+void CoreFile::resumeBrokenRecv(Core* core, uint32_t friendId, uint32_t fileId, ToxFile file)
+{
+    qDebug() << "Friend"<<friendId<<"offered broken transfer"<<file.fileNum<<"again as"<<fileId;
+    file.fileNum = fileId;
+
+    if (!file.file->isOpen())
+    {
+        // We never accepted it, it's still up to our user
+        file.status = ToxFile::STOPPED;
+        addFile(friendId, fileId, file);
+        emit core->fileTransferBrokenUnbroken(file, false);
+        return;
+    }
+
+    // Only ask for what isn't on the disk yet, the file is preallocated so its size doesn't tell
+    file.writeBehind->flush();
+    file.bytesSent = file.file->pos();
+    TOX_ERR_FILE_SEEK err;
+    if (file.bytesSent && !tox_file_seek(core->tox, friendId, fileId, file.bytesSent, &err))
+    {
+        qWarning() << "resumeBrokenRecv: Can't seek to"<<file.bytesSent<<", error"<<err;
+        file.bytesSent = 0;
+        file.file->seek(0);
+    }
+    qDebug() << "Resuming transfer"<<friendId<<":"<<fileId<<"from byte"<<file.bytesSent;
+
+    file.status = ToxFile::TRANSMITTING;
+    addFile(friendId, fileId, file);
+    tox_file_control(core->tox, friendId, fileId, TOX_FILE_CONTROL_RESUME, nullptr);
+    emit core->fileTransferBrokenUnbroken(file, false);
+}
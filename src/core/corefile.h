@@ -31,6 +31,8 @@
 #include <QString>
 #include <QMutex>
 #include <QHash>
+#include <QQueue>
+#include <QPair>
 
 struct Tox;
 class Core;
@@ -50,6 +52,7 @@ private:
     static void sendAvatarFile(Core* core, uint32_t friendId, const QByteArray& data);
     static void pauseResumeFileSend(Core* core, uint32_t friendId, uint32_t fileId);
     static void pauseResumeFileRecv(Core* core, uint32_t friendId, uint32_t fileId);
+    static void setFileSendPinned(uint32_t friendId, uint32_t fileId, bool pinned);
     static void cancelFileSend(Core* core, uint32_t friendId, uint32_t fileId);
     static void cancelFileRecv(Core* core, uint32_t friendId, uint32_t fileId);
     static void rejectFileRecvRequest(Core* core, uint32_t friendId, uint32_t fileId);
@@ -57,9 +60,32 @@ private:
     static ToxFile *findFile(uint32_t friendId, uint32_t fileId);
     static void addFile(uint32_t friendId, uint32_t fileId, const ToxFile& file);
     static void removeFile(uint32_t friendId, uint32_t fileId);
+    /// Closes the transfer's file once its background I/O is done, truncating an unfinished download
+    static void closeFile(ToxFile& file);
+    /// Key of a transfer in brokenFiles, the file ID is the only thing that survives a disconnect
+    static QByteArray getBrokenFileKey(uint32_t friendId, const QByteArray& resumeFileId);
+    /// Cancels a transfer that is waiting for its friend to come back
+    static void cancelBrokenFile(Core* core, uint32_t friendId, const QByteArray& resumeFileId);
+    /// Gives up on the received transfers whose sender didn't offer them again in time
+    static void expireBrokenFiles(Core* core);
+    /// Takes back a transfer our friend offered again after a disconnect, under its new file number
+    static void resumeBrokenRecv(Core* core, uint32_t friendId, uint32_t fileId, ToxFile file);
     /// Returns the maximum amount of time in ms that Core should wait between two
     /// tox_iterate calls to get good file transfer performances
     static unsigned corefileIterationInterval();
+    /// Sends the chunks toxcore requested, scheduling them between transfers
+    /// Friends take turns sharing a global budget per iteration. Within a friend, transfers get
+    /// a share of the friend's budget, and of toxcore's send queue, according to their weight
+    /// (deficit round robin), so a small file isn't stuck behind a bulk transfer.
+    static void sendPendingChunks(Core* core);
+    /// Sends the queued chunks of this file that were read already, up to budget bytes
+    /// Sets sendqFull if toxcore can't take more data for this friend.
+    /// Returns the number of bytes sent, or -1 if the transfer failed and was removed.
+    static qint64 sendQueuedChunks(Core* core, ToxFile& file, qint64 budget, bool& sendqFull);
+    /// Relative share of its friend's bandwidth this transfer gets
+    static int getTransferWeight(const ToxFile& file);
+    /// Emits fileTransferInfo, at most every progressInterval ms per transfer
+    static void reportProgress(Core* core, ToxFile& file);
 
 private:
     static void onFileReceiveCallback(Tox*, uint32_t friendnumber, uint32_t fileId, uint32_t kind,
@@ -73,8 +99,27 @@ private:
     static void onConnectionStatusChanged(Core* core, uint32_t friendId, bool online);
 
 private:
+    static constexpr qint64 progressInterval = 250;
+    static constexpr qint64 maxBytesPerIteration = 4*1024*1024; ///< Global send budget of one Core iteration
+    static constexpr qint64 quantumBytes = 8*1024; ///< Bytes a transfer of weight 1 may send per round
+    static constexpr quint64 smallFileSize = 4*1024*1024; ///< Files up to this size go before bulk transfers
+    static constexpr unsigned busyChunkRequests = 16; ///< More chunk requests than this per iteration is a busy link
+    static constexpr qint64 brokenRecvTimeout = 60*60*1000; ///< How long a broken received transfer waits for its sender
+    static constexpr qint64 brokenExpiryInterval = 60*1000;
     static QMutex fileSendMutex;
     static QHash<uint64_t, ToxFile> fileMap;
+    /// Transfers interrupted by a disconnect, by friend and file ID. toxcore forgets them and reuses
+    /// their file numbers, so they're kept apart until they are offered again with the same file ID.
+    static QHash<QByteArray, ToxFile> brokenFiles;
+    /// Chunk requests (position, length) waiting for their data, in the order toxcore made them
+    static QHash<uint64_t, QQueue<QPair<uint64_t, size_t>>> pendingChunks;
+    static QByteArray chunkBuffer; ///< Reused for every chunk we send, only used by the Core thread
+    static QHash<uint64_t, qint64> deficits; ///< Bytes each transfer with pending chunks may still send
+    static uint32_t lastServedFriend; ///< The next iteration starts with the friend after this one
+    static unsigned chunkRequests; ///< Chunks toxcore asked for since the last iteration interval
+    static bool fileStatesChanged; ///< Set when a transfer is added, removed, paused or resumed
+    static unsigned transferInterval; ///< Iteration interval our transfers need, valid until they change
+    static qint64 lastBrokenExpiry; ///< When expireBrokenFiles last looked at the broken transfers
 };
 
 #endif // COREFILE_H
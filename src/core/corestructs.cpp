@@ -9,12 +9,15 @@
 ToxFile::ToxFile(uint32_t FileNum, uint32_t FriendId, QByteArray FileName, QString FilePath, FileDirection Direction)
     : fileKind{TOX_FILE_KIND_DATA}, fileNum(FileNum), friendId(FriendId), fileName{FileName},
       filePath{FilePath}, file{new QFile(filePath)}, bytesSent{0}, filesize{0},
-      status{STOPPED}, direction{Direction}
+      status{STOPPED}, direction{Direction}, progressTimestamp{0}, brokenTimestamp{0}, pinned{false}
 {
 }
 
 bool ToxFile::operator==(const ToxFile &other) const
 {
+    // File numbers change when a broken transfer is resumed, the file ID doesn't
+    if (!resumeFileId.isEmpty() && !other.resumeFileId.isEmpty())
+        return (resumeFileId == other.resumeFileId) && (friendId == other.friendId) && (direction == other.direction);
     return (fileNum == other.fileNum) && (friendId == other.friendId) && (direction == other.direction);
 }
 
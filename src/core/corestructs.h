@@ -8,6 +8,8 @@
 #include <memory>
 class QFile;
 class QTimer;
+class FileReadAhead;
+class FileWriteBehind;
 
 enum class Status : int {Online = 0, Away, Busy, Offline};
 
@@ -51,12 +53,17 @@ struct ToxFile
     QByteArray fileName;
     QString filePath;
     std::shared_ptr<QFile> file;
+    std::shared_ptr<FileReadAhead> readAhead; ///< Serves the chunks of files we send, null otherwise
+    std::shared_ptr<FileWriteBehind> writeBehind; ///< Writes the chunks of files we accepted, null otherwise
     quint64 bytesSent;
     quint64 filesize;
     FileStatus status;
     FileDirection direction;
     QByteArray avatarData;
     QByteArray resumeFileId;
+    qint64 progressTimestamp; ///< When we last reported progress, in ms since the epoch
+    qint64 brokenTimestamp; ///< When a disconnect broke the transfer, in ms since the epoch
+    bool pinned; ///< The user asked for this transfer to go before the others
 };
 
 #endif // CORESTRUCTS_H
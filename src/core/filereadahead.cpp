@@ -0,0 +1,150 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QMutexLocker>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrentRun>
+#include <limits>
+#include "filereadahead.h"
+
+// Large enough to turn toxcore's chunk requests into few, sequential reads
+const qint64 FileReadAhead::blockSize = 1024*1024;
+const int FileReadAhead::blocksAhead = 4;
+
+FileReadAhead::FileReadAhead(const QString& path)
+    : file{path}, wantedBlock{0}, eofBlock{std::numeric_limits<quint64>::max()},
+      filling{false}, failed{false}, closed{false}
+{
+}
+
+FileReadAhead::~FileReadAhead()
+{
+    file.close();
+}
+
+qint64 FileReadAhead::read(quint64 pos, char* data, qint64 length)
+{
+    QMutexLocker locker{&lock};
+
+    if (failed)
+        return -1;
+
+    quint64 block = pos / blockSize;
+    if (block != wantedBlock)
+    {
+        wantedBlock = block;
+        // We only go forward, except when a transfer is restarted
+        while (!blocks.isEmpty() && blocks.firstKey() < wantedBlock)
+            blocks.erase(blocks.begin());
+    }
+    scheduleLockless();
+
+    // A chunk can straddle two blocks, only copy it once we have all of it
+    qint64 copied = 0;
+    while (copied < length)
+    {
+        quint64 offset = pos + copied;
+        auto it = blocks.constFind(offset / blockSize);
+        if (it == blocks.constEnd())
+        {
+            if (offset / blockSize >= eofBlock)
+                return copied ? copied : -1; // Past the end of the file
+            return 0;
+        }
+
+        const QByteArray& blockData = it.value();
+        qint64 blockOffset = offset % blockSize;
+        qint64 count = qMin(length - copied, blockData.size() - blockOffset);
+        if (count <= 0)
+            return copied ? copied : -1; // Past the end of the file
+        memcpy(data + copied, blockData.constData() + blockOffset, count);
+        copied += count;
+    }
+
+    return copied;
+}
+
+void FileReadAhead::close()
+{
+    QMutexLocker locker{&lock};
+    closed = true;
+    blocks.clear();
+}
+
+void FileReadAhead::scheduleLockless()
+{
+    if (filling || closed)
+        return;
+
+    for (quint64 i = wantedBlock; i <= wantedBlock + blocksAhead && i < eofBlock; ++i)
+    {
+        if (blocks.contains(i))
+            continue;
+
+        filling = true;
+        std::shared_ptr<FileReadAhead> self = shared_from_this();
+        QtConcurrent::run([self](){self->fill();});
+        return;
+    }
+}
+
+void FileReadAhead::fill()
+{
+    forever
+    {
+        quint64 block;
+        {
+            QMutexLocker locker{&lock};
+
+            block = wantedBlock;
+            while (block <= wantedBlock + blocksAhead && block < eofBlock && blocks.contains(block))
+                ++block;
+
+            if (closed || block > wantedBlock + blocksAhead || block >= eofBlock)
+            {
+                filling = false;
+                return;
+            }
+        }
+
+        // The disk access happens without the lock, toxcore can serve chunks meanwhile
+        QByteArray data;
+        bool ok = file.isOpen() || file.open(QIODevice::ReadOnly);
+        if (ok)
+            ok = file.seek(block * blockSize);
+        if (ok)
+        {
+            data = file.read(blockSize);
+            ok = file.error() == QFile::NoError;
+        }
+
+        QMutexLocker locker{&lock};
+        if (!ok)
+        {
+            qWarning() << "FileReadAhead: Failed to read" << file.fileName() << ":" << file.errorString();
+            failed = true;
+            filling = false;
+            return;
+        }
+
+        if (data.size() < blockSize)
+            eofBlock = block + 1;
+        if (!data.isEmpty() && block >= wantedBlock)
+            blocks.insert(block, data);
+    }
+}
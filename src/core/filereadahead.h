@@ -0,0 +1,69 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FILEREADAHEAD_H
+#define FILEREADAHEAD_H
+
+#include <QString>
+#include <QMutex>
+#include <QMap>
+#include <QByteArray>
+#include <QFile>
+#include <memory>
+
+/// Reads an outgoing file transfer ahead of toxcore's chunk requests on a worker thread
+/// toxcore asks for ~1KB chunks from its iteration thread, where a slow disk would stall
+/// every friend's traffic. Instead, the file is read in large blocks by a background task
+/// that stays a few blocks ahead of the last requested position, and the requests are
+/// served from memory.
+/// All methods are thread-safe.
+class FileReadAhead : public std::enable_shared_from_this<FileReadAhead>
+{
+public:
+    explicit FileReadAhead(const QString& path);
+    ~FileReadAhead();
+
+    /// Copies length bytes from pos to data if they were read already, and reads further ahead
+    /// Returns the number of bytes copied, 0 if they aren't ready yet, or -1 on error
+    qint64 read(quint64 pos, char* data, qint64 length);
+    /// Stops reading ahead, the file is closed once the background task is done
+    void close();
+
+private:
+    FileReadAhead(const FileReadAhead&)=delete;
+    FileReadAhead& operator=(const FileReadAhead&)=delete;
+
+    /// Starts the background task if blocks are missing. Callers must hold the lock.
+    void scheduleLockless();
+    /// Runs in the background, reads the missing blocks until we're far enough ahead
+    void fill();
+
+private:
+    static const qint64 blockSize; ///< Size of our reads from the disk
+    static const int blocksAhead; ///< Blocks kept read after the one being sent
+
+    QMutex lock;
+    QFile file; ///< Only used by the background task
+    QMap<quint64, QByteArray> blocks; ///< Blocks ready to be sent, by index
+    quint64 wantedBlock; ///< Block of the last requested chunk
+    quint64 eofBlock; ///< Index of the first block past the end of the file, once we know it
+    bool filling; ///< True while a background task runs
+    bool failed, closed;
+};
+
+#endif // FILEREADAHEAD_H
@@ -0,0 +1,130 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QMutexLocker>
+#include <QFile>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrentRun>
+#include "filewritebehind.h"
+
+// Large, page-aligned writes
+const int FileWriteBehind::blockSize = 1024*1024;
+const qint64 FileWriteBehind::maxQueuedBytes = 16*1024*1024;
+
+FileWriteBehind::FileWriteBehind(std::shared_ptr<QFile> file)
+    : file{file}, queuedBytes{0}, writing{false}, failed{false}, closed{false}
+{
+    buffer.reserve(blockSize);
+}
+
+bool FileWriteBehind::append(const char* data, qint64 length)
+{
+    QMutexLocker locker{&lock};
+
+    if (failed || closed)
+        return false;
+
+    buffer.append(data, length);
+    if (buffer.size() < blockSize)
+        return true;
+
+    queue.enqueue(buffer);
+    queuedBytes += buffer.size();
+    buffer = QByteArray();
+    buffer.reserve(blockSize);
+
+    if (queuedBytes > maxQueuedBytes)
+    {
+        locker.unlock();
+        writeQueued(false);
+        locker.relock();
+    }
+    else if (!writing)
+    {
+        writing = true;
+        std::shared_ptr<FileWriteBehind> self = shared_from_this();
+        QtConcurrent::run([self](){self->writeQueued(true);});
+    }
+
+    return !failed;
+}
+
+bool FileWriteBehind::flush()
+{
+    {
+        QMutexLocker locker{&lock};
+        if (closed)
+            return false;
+        if (!buffer.isEmpty())
+        {
+            queue.enqueue(buffer);
+            queuedBytes += buffer.size();
+            buffer = QByteArray();
+        }
+    }
+
+    writeQueued(false);
+
+    QMutexLocker ioLocker{&ioLock};
+    QMutexLocker locker{&lock};
+    if (!failed && !file->flush())
+        failed = true;
+    return !failed;
+}
+
+void FileWriteBehind::close()
+{
+    {
+        QMutexLocker locker{&lock};
+        closed = true;
+        queue.clear();
+        queuedBytes = 0;
+        buffer.clear();
+    }
+
+    // Once we have it, no one will touch the file again
+    QMutexLocker ioLocker{&ioLock};
+}
+
+void FileWriteBehind::writeQueued(bool background)
+{
+    forever
+    {
+        QMutexLocker ioLocker{&ioLock};
+
+        QByteArray block;
+        {
+            QMutexLocker locker{&lock};
+            if (queue.isEmpty() || failed)
+            {
+                if (background)
+                    writing = false;
+                return;
+            }
+            block = queue.dequeue();
+            queuedBytes -= block.size();
+        }
+
+        if (file->write(block) != block.size())
+        {
+            qWarning() << "FileWriteBehind: Failed to write to" << file->fileName() << ":" << file->errorString();
+            QMutexLocker locker{&lock};
+            failed = true;
+        }
+    }
+}
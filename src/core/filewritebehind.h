@@ -0,0 +1,69 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FILEWRITEBEHIND_H
+#define FILEWRITEBEHIND_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QByteArray>
+#include <memory>
+
+class QFile;
+
+/// Writes an incoming file transfer to the disk on a worker thread
+/// toxcore hands us ~1KB chunks from its iteration thread, writing each of them there means
+/// many small writes and a stalled toxcore whenever the disk is slow. Chunks are gathered
+/// in large blocks instead, and full blocks are written in order by a background task.
+/// Writes fall back to the caller's thread when the disk can't keep up, to bound our memory use.
+/// All methods are thread-safe.
+class FileWriteBehind : public std::enable_shared_from_this<FileWriteBehind>
+{
+public:
+    explicit FileWriteBehind(std::shared_ptr<QFile> file);
+
+    /// Appends data at the end of what we wrote so far. Returns false if a write failed.
+    bool append(const char* data, qint64 length);
+    /// Writes everything appended so far before returning. Returns false if a write failed.
+    bool flush();
+    /// Waits for the write in progress, if any, and drops what wasn't written yet
+    void close();
+
+private:
+    FileWriteBehind(const FileWriteBehind&)=delete;
+    FileWriteBehind& operator=(const FileWriteBehind&)=delete;
+
+    /// Writes the queued blocks in order until there are none left
+    /// The background task clears the writing flag when it's done, other callers don't.
+    void writeQueued(bool background);
+
+private:
+    static const int blockSize; ///< Size of our writes to the disk
+    static const qint64 maxQueuedBytes; ///< Past this, we write in the caller's thread
+
+    QMutex lock;
+    QMutex ioLock; ///< Held while taking a block and writing it, so blocks are written in order
+    std::shared_ptr<QFile> file;
+    QByteArray buffer; ///< Block being filled
+    QQueue<QByteArray> queue; ///< Full blocks waiting to be written
+    qint64 queuedBytes;
+    bool writing; ///< True while a background task runs
+    bool failed, closed;
+};
+
+#endif // FILEWRITEBEHIND_H
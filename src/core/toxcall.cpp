@@ -1,4 +1,5 @@
 #include "src/audio/audio.h"
+#include "src/audio/audiomixer.h"
 #include "src/core/toxcall.h"
 #include "src/core/coreav.h"
 #include "src/persistence/settings.h"
@@ -14,21 +15,21 @@
 using namespace std;
 
 ToxCall::ToxCall(uint32_t CallId)
-    : callId{CallId}, alSource{0},
+    : callId{CallId}, mixerStream{0},
       inactive{true}, muteMic{false}, muteVol{false}
 {
     Audio& audio = Audio::getInstance();
     audio.subscribeInput();
-    audio.subscribeOutput(alSource);
+    mixerStream = AudioMixer::getInstance().addStream();
 }
 
 ToxCall::ToxCall(ToxCall&& other) noexcept
-    : audioInConn{other.audioInConn}, callId{other.callId}, alSource{other.alSource},
+    : audioInConn{other.audioInConn}, callId{other.callId}, mixerStream{other.mixerStream},
       inactive{other.inactive}, muteMic{other.muteMic}, muteVol{other.muteVol}
 {
     other.audioInConn = QMetaObject::Connection();
     other.callId = numeric_limits<decltype(callId)>::max();
-    other.alSource = 0;
+    other.mixerStream = 0;
 
     // required -> ownership of audio input is moved to new instance
     Audio& audio = Audio::getInstance();
@@ -41,7 +42,7 @@ ToxCall::~ToxCall()
 
     QObject::disconnect(audioInConn);
     audio.unsubscribeInput();
-    audio.unsubscribeOutput(alSource);
+    AudioMixer::getInstance().removeStream(mixerStream);
 }
 
 const ToxCall& ToxCall::operator=(ToxCall&& other) noexcept
@@ -53,8 +54,8 @@ const ToxCall& ToxCall::operator=(ToxCall&& other) noexcept
     inactive = other.inactive;
     muteMic = other.muteMic;
     muteVol = other.muteVol;
-    alSource = other.alSource;
-    other.alSource = 0;
+    mixerStream = other.mixerStream;
+    other.mixerStream = 0;
 
     // required -> ownership of audio input is moved to new instance
     Audio& audio = Audio::getInstance();
@@ -104,6 +105,7 @@ ToxFriendCall::ToxFriendCall(uint32_t FriendNum, bool VideoEnabled, CoreAV& av)
 
     if (videoEnabled)
     {
+        rateControl.reset(new VideoRateController(CoreAV::VIDEO_DEFAULT_BITRATE));
         videoSource = new CoreVideoSource;
         CameraSource& source = CameraSource::getInstance();
         if (!source.isOpen())
@@ -117,7 +119,7 @@ ToxFriendCall::ToxFriendCall(uint32_t FriendNum, bool VideoEnabled, CoreAV& av)
 ToxFriendCall::ToxFriendCall(ToxFriendCall&& other) noexcept
     : ToxCall(move(other)),
       videoEnabled{other.videoEnabled}, nullVideoBitrate{other.nullVideoBitrate},
-      videoSource{other.videoSource}, state{other.state},
+      videoSource{other.videoSource}, rateControl{move(other.rateControl)}, state{other.state},
       av{other.av}, timeoutTimer{other.timeoutTimer}
 {
     other.videoEnabled = false;
@@ -151,6 +153,7 @@ const ToxFriendCall& ToxFriendCall::operator=(ToxFriendCall&& other) noexcept
     other.videoEnabled = false;
     videoSource = other.videoSource;
     other.videoSource = nullptr;
+    rateControl = move(other.rateControl);
     state = other.state;
     timeoutTimer = other.timeoutTimer;
     other.timeoutTimer = nullptr;
@@ -2,10 +2,12 @@
 #define TOXCALL_H
 
 #include <cstdint>
+#include <memory>
 #include <QtGlobal>
 #include <QMetaObject>
 
 #include "src/core/indexedlist.h"
+#include "src/core/videoratecontroller.h"
 
 #include <tox/toxav.h>
 
@@ -33,7 +35,7 @@ protected:
 
 public:
     uint32_t callId; ///< Could be a friendNum or groupNum, must uniquely identify the call. Do not modify!
-    quint32 alSource;
+    int mixerStream; ///< Our output stream in the AudioMixer
     bool inactive; ///< True while we're not participating. (stopped group call, ringing but hasn't started yet, ...)
     bool muteMic;
     bool muteVol;
@@ -51,6 +53,7 @@ struct ToxFriendCall : public ToxCall
     bool videoEnabled; ///< True if our user asked for a video call, sending and recving
     bool nullVideoBitrate; ///< True if our video bitrate is zero, i.e. if the device is closed
     CoreVideoSource* videoSource;
+    std::unique_ptr<VideoRateController> rateControl; ///< Adapts the video we send, null without video
     TOXAV_FRIEND_CALL_STATE state; ///< State of the peer (not ours!)
 
     void startTimeout();
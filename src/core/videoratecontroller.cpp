@@ -0,0 +1,142 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QMutexLocker>
+#include <algorithm>
+#include "videoratecontroller.h"
+
+// Bits per pixel drop fast with the size, so we shrink the frames before cutting the frame rate
+const VideoRateController::Tier VideoRateController::tiers[] =
+{
+    {1000, 1, 1},
+    {400, 2, 1},
+    {150, 2, 2},
+    {0, 4, 2},
+};
+const int64_t VideoRateController::windowMs = 1000;
+const int VideoRateController::dropPercentThreshold = 10;
+
+VideoRateController::VideoRateController(uint32_t maxBitrate, uint32_t minBitrate)
+    : maxBitrate{maxBitrate}, minBitrate{std::min(minBitrate, maxBitrate)},
+      bitrate{maxBitrate}, recommendedBitrate{0},
+      windowStart{-1}, windowSent{0}, windowDropped{0}, frameCounter{0}, fps{0},
+      framesSent{0}, framesDropped{0}, framesSkipped{0}
+{
+}
+
+void VideoRateController::setRecommendedBitrate(uint32_t newBitrate)
+{
+    QMutexLocker locker{&lock};
+    recommendedBitrate = newBitrate;
+}
+
+bool VideoRateController::shouldSendFrame()
+{
+    QMutexLocker locker{&lock};
+
+    if (frameCounter++ % getTier().frameDivisor == 0)
+        return true;
+
+    ++framesSkipped;
+    return false;
+}
+
+QSize VideoRateController::getFrameSize(QSize sourceSize) const
+{
+    QMutexLocker locker{&lock};
+
+    int divisor = getTier().sizeDivisor;
+    if (divisor == 1)
+        return sourceSize;
+
+    // YUV420 needs even dimensions
+    return {std::max(sourceSize.width() / divisor, 2) & ~1,
+            std::max(sourceSize.height() / divisor, 2) & ~1};
+}
+
+bool VideoRateController::reportFrame(bool sent, QSize size, int64_t now)
+{
+    QMutexLocker locker{&lock};
+
+    if (sent)
+    {
+        ++framesSent;
+        ++windowSent;
+        lastFrameSize = size;
+    }
+    else
+    {
+        ++framesDropped;
+        ++windowDropped;
+    }
+
+    uint32_t oldBitrate = bitrate;
+
+    if (windowStart < 0)
+        windowStart = now;
+    else if (now - windowStart >= windowMs)
+        evaluateWindow(now);
+
+    // A new recommendation applies right away, we don't wait for drops to confirm it
+    bitrate = std::min(bitrate, getCeiling());
+
+    return bitrate != oldBitrate;
+}
+
+uint32_t VideoRateController::getBitrate() const
+{
+    QMutexLocker locker{&lock};
+    return bitrate;
+}
+
+VideoRateController::Stats VideoRateController::getStats() const
+{
+    QMutexLocker locker{&lock};
+    return {bitrate, recommendedBitrate, fps, framesSent, framesDropped, framesSkipped, lastFrameSize};
+}
+
+const VideoRateController::Tier& VideoRateController::getTier() const
+{
+    for (const Tier& tier : tiers)
+        if (bitrate >= tier.minBitrate)
+            return tier;
+
+    return tiers[sizeof(tiers)/sizeof(*tiers) - 1];
+}
+
+uint32_t VideoRateController::getCeiling() const
+{
+    if (!recommendedBitrate)
+        return maxBitrate;
+
+    return std::max(std::min(recommendedBitrate, maxBitrate), minBitrate);
+}
+
+void VideoRateController::evaluateWindow(int64_t now)
+{
+    int total = windowSent + windowDropped;
+    fps = windowSent * 1000.f / (now - windowStart);
+
+    if (windowDropped * 100 > total * dropPercentThreshold)
+        bitrate = std::max(bitrate * 7 / 10, minBitrate);
+    else if (!windowDropped)
+        bitrate = std::min(bitrate + std::max(getCeiling() / 10, 32u), getCeiling());
+
+    windowStart = now;
+    windowSent = windowDropped = 0;
+}
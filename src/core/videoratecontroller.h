@@ -0,0 +1,92 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VIDEORATECONTROLLER_H
+#define VIDEORATECONTROLLER_H
+
+#include <QMutex>
+#include <QSize>
+#include <cstdint>
+
+/// Adapts the video we send in a call to what the link can carry
+/// The encoder bitrate follows toxav's recommendations and our own send failures:
+/// it backs off multiplicatively when too many frames fail to send in a window and
+/// climbs back additively while none do. The frame size and frame rate are derived
+/// from the bitrate, so a slow link gets fewer, smaller frames instead of stalling.
+/// The caller provides the time, in milliseconds from any fixed origin, so the
+/// controller can be fed recorded or synthetic traces.
+/// All methods are thread-safe.
+class VideoRateController
+{
+public:
+    struct Stats
+    {
+        uint32_t bitrate; ///< Current encoder bitrate in kb/s
+        uint32_t recommendedBitrate; ///< Last recommendation from toxav in kb/s, 0 if none
+        float fps; ///< Frames actually sent per second over the last window
+        quint64 framesSent, framesDropped, framesSkipped;
+        QSize frameSize; ///< Size of the last frame we sent
+    };
+
+public:
+    VideoRateController(uint32_t maxBitrate, uint32_t minBitrate = 64);
+
+    /// Called when toxav recommends a new video bitrate, in kb/s
+    void setRecommendedBitrate(uint32_t bitrate);
+    /// Returns false if the frame should be skipped to lower our frame rate
+    bool shouldSendFrame();
+    /// Returns the size frames of this size should be scaled to before encoding
+    QSize getFrameSize(QSize sourceSize) const;
+    /// Records whether a frame of this size could be sent at this time
+    /// Returns true if the bitrate changed and must be applied to the encoder
+    bool reportFrame(bool sent, QSize size, int64_t now);
+    /// Current encoder bitrate in kb/s
+    uint32_t getBitrate() const;
+    Stats getStats() const;
+
+private:
+    /// A step of our quality ladder, used while the bitrate is at least minBitrate
+    struct Tier
+    {
+        uint32_t minBitrate;
+        int sizeDivisor; ///< Both dimensions of the frames are divided by this
+        int frameDivisor; ///< Only one frame out of frameDivisor is sent
+    };
+
+    const Tier& getTier() const;
+    uint32_t getCeiling() const;
+    /// Adjusts the bitrate at the end of a window from the frames sent and dropped in it
+    void evaluateWindow(int64_t now);
+
+private:
+    static const Tier tiers[];
+    static const int64_t windowMs; ///< Length of the windows over which we judge the link
+    static const int dropPercentThreshold; ///< Back off when more than this share of frames fails
+
+    mutable QMutex lock;
+    const uint32_t maxBitrate, minBitrate;
+    uint32_t bitrate, recommendedBitrate;
+    int64_t windowStart;
+    int windowSent, windowDropped;
+    int frameCounter;
+    float fps;
+    quint64 framesSent, framesDropped, framesSkipped;
+    QSize lastFrameSize;
+};
+
+#endif // VIDEORATECONTROLLER_H
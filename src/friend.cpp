@@ -39,8 +39,9 @@ Friend::Friend(uint32_t FriendId, const ToxId &UserId)
 
     userAlias = Settings::getInstance().getFriendAlias(UserId);
 
+    // Most contacts are never opened in a session, their chat form is created on demand
     widget = new FriendWidget(friendId, getDisplayedName());
-    chatForm = new ChatForm(this);
+    chatForm = nullptr;
 }
 
 Friend::~Friend()
@@ -51,9 +52,9 @@ Friend::~Friend()
 
 void Friend::loadHistory()
 {
-    if (Nexus::getProfile()->isHistoryEnabled())
+    if (chatForm && Nexus::getProfile()->isHistoryEnabled())
     {
-        chatForm->loadHistory(QDateTime::currentDateTime().addDays(-7), true);
+        chatForm->loadLatestHistory();
         widget->historyLoaded = true;
     }
 }
@@ -67,7 +68,8 @@ void Friend::setName(QString name)
     if (userAlias.size() == 0)
     {
         widget->setName(name);
-        chatForm->setName(name);
+        if (chatForm)
+            chatForm->setName(name);
 
         if (widget->isActive())
             GUI::setWindowTitle(name);
@@ -82,7 +84,8 @@ void Friend::setAlias(QString name)
     QString dispName = userAlias.size() == 0 ? userName : userAlias;
 
     widget->setName(dispName);
-    chatForm->setName(dispName);
+    if (chatForm)
+        chatForm->setName(dispName);
 
     if (widget->isActive())
             GUI::setWindowTitle(dispName);
@@ -94,7 +97,8 @@ void Friend::setStatusMessage(QString message)
 {
     statusMessage = message;
     widget->setStatusMsg(message);
-    chatForm->setStatusMessage(message);
+    if (chatForm)
+        chatForm->setStatusMessage(message);
 }
 
 QString Friend::getStatusMessage()
@@ -147,9 +151,22 @@ Status Friend::getStatus() const
 
 ChatForm *Friend::getChatForm()
 {
+    if (!chatForm)
+    {
+        chatForm = new ChatForm(this);
+        chatForm->setStatusMessage(statusMessage);
+        emit chatFormCreated(this);
+        // The friend is in the friendlist by now, the history would show blank names otherwise
+        loadHistory();
+    }
     return chatForm;
 }
 
+bool Friend::hasChatForm() const
+{
+    return chatForm != nullptr;
+}
+
 FriendWidget *Friend::getFriendWidget()
 {
     return widget;
@@ -37,7 +37,7 @@ public:
     ~Friend();
     Friend& operator=(const Friend& other)=delete;
 
-    /// Loads the friend's chat history if enabled
+    /// Loads the friend's chat history if enabled and the chat form exists
     void loadHistory();
 
     void setName(QString name);
@@ -57,12 +57,16 @@ public:
     void setStatus(Status s);
     Status getStatus() const;
 
+    /// Returns the chat form, creating it and loading its history on first use
     ChatForm *getChatForm();
+    bool hasChatForm() const; ///< Returns true if the chat form was already created
     FriendWidget *getFriendWidget();
     const FriendWidget *getFriendWidget() const;
 
 signals:
     void displayedNameChanged(FriendWidget* widget, Status s, int hasNewEvents);
+    /// Emitted when the chat form is created, before its history is loaded
+    void chatFormCreated(Friend* f);
 
 private:
     QString userAlias, userName, statusMessage;
@@ -27,6 +27,8 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QCoreApplication>
+#include <QEventLoop>
+#include <QTimer>
 #include <QFile>
 #include <QDir>
 #include <QProcess>
@@ -95,6 +97,24 @@ bool AutoUpdater::isUpdateAvailable()
     return !diff.isEmpty();
 }
 
+bool AutoUpdater::waitForReply(QNetworkReply* reply)
+{
+    // Sleep on a local loop until the reply is done, waking up now and then to check for aborts
+    QEventLoop loop;
+    QTimer abortCheck;
+    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    QObject::connect(&abortCheck, &QTimer::timeout, [&]()
+    {
+        if (abortFlag)
+            loop.quit();
+    });
+    abortCheck.start(abortCheckInterval);
+    while (!reply->isFinished() && !abortFlag)
+        loop.exec();
+
+    return !abortFlag;
+}
+
 AutoUpdater::VersionInfo AutoUpdater::getUpdateVersion()
 {
     VersionInfo versionInfo;
@@ -110,12 +130,8 @@ AutoUpdater::VersionInfo AutoUpdater::getUpdateVersion()
     QNetworkAccessManager *manager = new QNetworkAccessManager;
     manager->setProxy(Settings::getInstance().getProxy());
     QNetworkReply* reply = manager->get(QNetworkRequest(QUrl(checkURI)));
-    while (!reply->isFinished())
-    {
-        if (abortFlag)
-            return versionInfo;
-        qApp->processEvents();
-    }
+    if (!waitForReply(reply))
+        return versionInfo;
 
     if (reply->error() != QNetworkReply::NoError)
     {
@@ -225,12 +241,8 @@ QByteArray AutoUpdater::getUpdateFlist()
     QNetworkAccessManager *manager = new QNetworkAccessManager;
     manager->setProxy(Settings::getInstance().getProxy());
     QNetworkReply* reply = manager->get(QNetworkRequest(QUrl(flistURI)));
-    while (!reply->isFinished())
-    {
-        if (abortFlag)
-            return flist;
-        qApp->processEvents();
-    }
+    if (!waitForReply(reply))
+        return flist;
 
     if (reply->error() != QNetworkReply::NoError)
     {
@@ -283,12 +295,8 @@ AutoUpdater::UpdateFile AutoUpdater::getUpdateFile(UpdateFileMeta fileMeta,
     manager->setProxy(Settings::getInstance().getProxy());
     QNetworkReply* reply = manager->get(QNetworkRequest(QUrl(filesURI+fileMeta.id)));
     QObject::connect(reply, &QNetworkReply::downloadProgress, progressCallback);
-    while (!reply->isFinished())
-    {
-        if (abortFlag)
-            return file;
-        qApp->processEvents();
-    }
+    if (!waitForReply(reply))
+        return file;
 
     if (reply->error() != QNetworkReply::NoError)
     {
@@ -28,6 +28,8 @@
 #include <atomic>
 #include <functional>
 
+class QNetworkReply;
+
 /// For now we only support auto updates on Windows and OS X, although extending it is not a technical issue.
 /// Linux users are expected to use their package managers or update manually through official channels.
 #ifdef Q_OS_WIN
@@ -73,16 +75,16 @@ public:
 public:
     /// Connects to the qTox update server, if an updat is found shows a dialog to the user asking to download it
     /// Runs asynchronously in its own thread, and will return immediatly
-    /// Will call isUpdateAvailable, and as such may processEvents
+    /// Will call isUpdateAvailable, which only blocks the worker thread
     static void checkUpdatesAsyncInteractive();
     /// Connects to the qTox update server, returns true if an update is available for download
-    /// Will call getUpdateVersion, and as such may block and processEvents
+    /// Will call getUpdateVersion, and as such blocks the calling thread
     static bool isUpdateAvailable();
     /// Fetch the version info of the last update available from the qTox update server
-    /// Will try to follow qTox's proxy settings, may block and processEvents
+    /// Will try to follow qTox's proxy settings, blocks the calling thread
     static VersionInfo getUpdateVersion();
     /// Will try to download an update, if successful returns true and qTox will apply it after a restart
-    /// Will try to follow qTox's proxy settings, may block and processEvents
+    /// Will try to follow qTox's proxy settings, blocks the calling thread
     static bool downloadUpdate();
     /// Returns true if an update is downloaded and ready to be installed,
     /// if so, call installLocalUpdate.
@@ -104,7 +106,7 @@ protected:
     /// Parses and validates a flist file. Returns an empty list on error
     static QList<UpdateFileMeta> parseFlist(QByteArray flistData);
     /// Gets the update server's flist. Returns an empty array on error
-    /// Will try to follow qTox's proxy settings, may block and processEvents
+    /// Will try to follow qTox's proxy settings, blocks the calling thread
     static QByteArray getUpdateFlist();
     /// Generates a list of files we need to update
     static QList<UpdateFileMeta> genUpdateDiff(QList<UpdateFileMeta> updateFlist);
@@ -112,13 +114,15 @@ protected:
     static bool isUpToDate(UpdateFileMeta file);
     /// Tries to fetch the file from the update server. Returns a file with a null QByteArray on error.
     /// Note that a file with an empty but non-null QByteArray is not an error, merely a file of size 0.
-    /// Will try to follow qTox's proxy settings, may block and processEvents
+    /// Will try to follow qTox's proxy settings, blocks the calling thread
     static UpdateFile getUpdateFile(UpdateFileMeta fileMeta, std::function<void(int,int)> progressCallback);
     /// Does the actual work for checkUpdatesAsyncInteractive
     /// Blocking, but otherwise has the same properties than checkUpdatesAsyncInteractive
     static void checkUpdatesAsyncInteractiveWorker();
     /// Thread safe setter
     static void setProgressVersion(QString version);
+    /// Waits for the reply on a local event loop, returns false if the updates were aborted meanwhile
+    static bool waitForReply(QNetworkReply* reply);
 
 private:
     AutoUpdater() = delete;
@@ -133,6 +137,7 @@ private:
     static const QString updaterBin; ///< Path to the qtox-updater binary
     static unsigned char key[];
     static std::atomic_bool abortFlag; ///< If true, try to abort everything.
+    static constexpr int abortCheckInterval = 100; ///< How often pending requests check abortFlag, in ms
     static std::atomic_bool isDownloadingUpdate; ///< We'll pretend there's no new update available if we're already updating
     static std::atomic<float> progressValue;
     static QString progressVersion;
@@ -20,9 +20,10 @@
 
 #include "src/net/toxdns.h"
 #include "src/core/cdata.h"
+#include "src/net/toxresolver.h"
 #include <QMessageBox>
-#include <QCoreApplication>
-#include <QThread>
+#include <QEventLoop>
+#include <QTimer>
 #include <QDebug>
 #include <tox/tox.h>
 #include <tox/toxdns.h>
@@ -59,13 +60,14 @@ QByteArray ToxDNS::fetchLastTextRecord(const QString& record, bool silent)
     dns.setName(record);
     dns.lookup();
 
-    int timeout;
-    for (timeout = 0; timeout<30 && !dns.isFinished(); ++timeout)
-    {
-        qApp->processEvents();
-        QThread::msleep(100);
-    }
-    if (timeout >= 30)
+    // Sleep on a local loop until the lookup is done, instead of spinning on processEvents
+    QEventLoop loop;
+    connect(&dns, &QDnsLookup::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(lookupTimeout, &loop, SLOT(quit()));
+    if (!dns.isFinished())
+        loop.exec();
+
+    if (!dns.isFinished())
     {
         dns.abort();
         if (!silent)
@@ -217,10 +219,16 @@ ToxId ToxDNS::resolveToxAddress(const QString &address, bool silent)
         }
 
         // Otherwise try toxdns3 if we can get a pubkey or fallback to toxdns1
-        QByteArray pubkey = fetchLastTextRecord("_tox."+servname, true);
+        QByteArray pubkey = ToxResolver::getCached("toxdns-pk:" + servname);
+        if (pubkey.isEmpty())
+        {
+            pubkey = QByteArray::fromHex(fetchLastTextRecord("_tox."+servname, true));
+            if (!pubkey.isEmpty())
+                ToxResolver::setCached("toxdns-pk:" + servname, pubkey, ToxResolver::pubkeyTTL, true);
+        }
+
         if (!pubkey.isEmpty())
         {
-            pubkey = QByteArray::fromHex(pubkey);
 
             QByteArray servnameData = servname.toUtf8();
             ToxDNS::tox3_server server;
@@ -52,10 +52,12 @@ protected:
 
 private:
     /// Try to fetch the first entry of the given TXT record
-    /// Returns an empty object on failure. May block for up to ~3s
-    /// May display message boxes on error if silent if false
+    /// Returns an empty object on failure. Blocks the calling thread for up to lookupTimeout ms
+    /// May display message boxes on error if silent if false, which must then be called from the GUI thread
     static QByteArray fetchLastTextRecord(const QString& record, bool silent=true);
 
+    static constexpr int lookupTimeout = 3000;
+
 public:
     static const tox3_server pinnedServers[4];
 };
@@ -19,17 +19,36 @@
 
 #include "toxme.h"
 #include "src/core/core.h"
+#include "src/net/toxresolver.h"
 #include <src/persistence/settings.h>
 #include <QtDebug>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
-#include <QCoreApplication>
-#include <QThread>
+#include <QEventLoop>
+#include <QTimer>
 #include <sodium/crypto_box.h>
 #include <sodium/randombytes.h>
 #include <string>
 #include <ctime>
 
+void Toxme::waitForReply(QNetworkReply* reply)
+{
+    if (reply->isFinished())
+        return;
+
+    // A local loop sleeps until the reply is done, instead of spinning on processEvents
+    QEventLoop loop;
+    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(requestTimeout, &loop, SLOT(quit()));
+    loop.exec();
+
+    if (!reply->isFinished())
+    {
+        qWarning() << "waitForReply: Request to" << reply->url().host() << "timed out";
+        reply->abort();
+    }
+}
+
 QByteArray Toxme::makeJsonRequest(QString url, QString json, QNetworkReply::NetworkError &error)
 {
     if (error)
@@ -41,11 +60,7 @@ QByteArray Toxme::makeJsonRequest(QString url, QString json, QNetworkReply::Netw
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     QNetworkReply* reply = netman.post(request,json.toUtf8());
 
-    while (!reply->isFinished())
-    {
-        QThread::msleep(1);
-        qApp->processEvents();
-    }
+    waitForReply(reply);
 
     error = reply->error();
     if (error)
@@ -62,6 +77,10 @@ QByteArray Toxme::getServerPubkey(QString url, QNetworkReply::NetworkError &erro
     if (error)
         return QByteArray();
 
+    QByteArray cachedKey = ToxResolver::getCached("toxme-pk:" + url);
+    if (!cachedKey.isEmpty())
+        return cachedKey;
+
     // Get key
     QNetworkAccessManager netman;
     netman.setProxy(Settings::getInstance().getProxy());
@@ -69,11 +88,7 @@ QByteArray Toxme::getServerPubkey(QString url, QNetworkReply::NetworkError &erro
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     QNetworkReply* reply = netman.get(request);
 
-    while (!reply->isFinished())
-    {
-        QThread::msleep(1);
-        qApp->processEvents();
-    }
+    waitForReply(reply);
 
     error = reply->error();
     if (error)
@@ -99,6 +114,9 @@ QByteArray Toxme::getServerPubkey(QString url, QNetworkReply::NetworkError &erro
         key[i] = byte.toInt(nullptr, 16);
     }
 
+    if (key.size() == crypto_box_PUBLICKEYBYTES)
+        ToxResolver::setCached("toxme-pk:" + url, key, ToxResolver::pubkeyTTL, true);
+
     return key;
 }
 
@@ -32,7 +32,7 @@ class QNetworkAccessManager;
 
 /// This class implements a client for the toxme.se API
 /// The class is thread safe
-/// May process events while waiting for blocking calls
+/// Calls block the calling thread until the server replies, lookups from the GUI should go through ToxResolver
 class Toxme
 {
 public:
@@ -60,6 +60,8 @@ public:
 
 private:
     Toxme()=delete;
+    /// Waits for the reply to finish, aborts it after requestTimeout ms
+    static void waitForReply(QNetworkReply* reply);
     static QByteArray makeJsonRequest(QString url, QString json, QNetworkReply::NetworkError &error);
     static QByteArray prepareEncryptedJson(QString url, int action, QString payload);
     static QByteArray getServerPubkey(QString url, QNetworkReply::NetworkError &error);
@@ -69,6 +71,7 @@ private:
 private:
     static const QMap<QString, QString> pubkeyUrls;
     static const QMap<QString, QString> apiUrls;
+    static constexpr int requestTimeout = 10000;
 };
 
 #endif // TOXME_H
@@ -0,0 +1,202 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "toxresolver.h"
+#include "src/net/toxme.h"
+#include "src/net/toxdns.h"
+#include "src/persistence/settings.h"
+#include <QtConcurrent/QtConcurrentRun>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QSettings>
+#include <QDateTime>
+#include <QFile>
+
+QMutex ToxResolver::cacheLock;
+bool ToxResolver::cacheLoaded{false};
+QHash<QString, ToxResolver::CacheEntry> ToxResolver::cache;
+QHash<QString, QFuture<ToxId>> ToxResolver::pending;
+QThreadPool ToxResolver::lookupPool;
+
+void ToxResolver::resolve(const QString& address, Source sources, QObject* context, std::function<void(ToxId)> callback)
+{
+    if (address.isEmpty() || ToxId::isToxId(address))
+    {
+        callback(ToxId(address));
+        return;
+    }
+
+    ToxId toxId = getCachedId(address, sources);
+    if (!toxId.toString().isEmpty())
+    {
+        callback(toxId);
+        return;
+    }
+
+    QFuture<ToxId> future;
+    {
+        QMutexLocker locker(&cacheLock);
+        QString key = QString::number(sources) + ':' + address;
+        auto it = pending.find(key);
+        if (it != pending.end())
+        {
+            future = *it;
+        }
+        else
+        {
+            // Lookups block their thread for up to a few seconds, keep them out of the global pool
+            future = QtConcurrent::run(&lookupPool, [=]()
+            {
+                ToxId toxId = lookup(address, sources);
+                QMutexLocker locker(&cacheLock);
+                pending.remove(key);
+                return toxId;
+            });
+            pending[key] = future;
+        }
+    }
+
+    auto watcher = new QFutureWatcher<ToxId>(context);
+    QObject::connect(watcher, &QFutureWatcher<ToxId>::finished, context, [=]()
+    {
+        ToxId toxId = watcher->result();
+        watcher->deleteLater();
+        callback(toxId);
+    });
+    watcher->setFuture(future);
+}
+
+ToxId ToxResolver::getCachedId(const QString& address, Source sources)
+{
+    ToxId toxId;
+    if (sources & UseToxme)
+        toxId = ToxId(QString::fromUtf8(getCached("toxme:" + address)));
+    if (toxId.toString().isEmpty() && (sources & UseToxDns))
+        toxId = ToxId(QString::fromUtf8(getCached("toxdns:" + address)));
+    return toxId;
+}
+
+ToxId ToxResolver::lookup(QString address, Source sources)
+{
+    ToxId toxId = getCachedId(address, sources);
+    if (!toxId.toString().isEmpty())
+        return toxId;
+
+    if (sources & UseToxme)
+    {
+        toxId = Toxme::lookup(address);
+        if (!toxId.toString().isEmpty())
+        {
+            setCached("toxme:" + address, toxId.toString().toUtf8(), addressTTL);
+            return toxId;
+        }
+    }
+
+    if (sources & UseToxDns)
+    {
+        toxId = ToxDNS::resolveToxAddress(address, true);
+        if (!toxId.toString().isEmpty())
+            setCached("toxdns:" + address, toxId.toString().toUtf8(), addressTTL);
+    }
+
+    return toxId;
+}
+
+QByteArray ToxResolver::getCached(const QString& key)
+{
+    QMutexLocker locker(&cacheLock);
+    loadCache();
+
+    auto it = cache.find(key);
+    if (it == cache.end())
+        return QByteArray();
+
+    if (it->expires <= QDateTime::currentMSecsSinceEpoch() / 1000)
+    {
+        cache.erase(it);
+        return QByteArray();
+    }
+
+    return it->value;
+}
+
+void ToxResolver::setCached(const QString& key, const QByteArray& value, int ttl, bool persistent)
+{
+    QMutexLocker locker(&cacheLock);
+    loadCache();
+
+    cache[key] = {value, QDateTime::currentMSecsSinceEpoch() / 1000 + ttl, persistent};
+    if (persistent)
+        saveCache();
+}
+
+void ToxResolver::loadCache()
+{
+    if (cacheLoaded)
+        return;
+
+    cacheLoaded = true;
+
+    // Older versions stored the looked up addresses too, in a file shared by all profiles
+    QFile::remove(Settings::getInstance().getSettingsDirPath() + "resolvercache.ini");
+
+    QSettings ps(Settings::getInstance().getSettingsDirPath() + "resolverkeys.ini", QSettings::IniFormat);
+    qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+    int size = ps.beginReadArray("Entries");
+    for (int i = 0; i < size; ++i)
+    {
+        ps.setArrayIndex(i);
+        qint64 expires = ps.value("expires").toLongLong();
+        if (expires <= now)
+            continue;
+
+        QByteArray value = QByteArray::fromHex(ps.value("value").toString().toLatin1());
+        cache[ps.value("key").toString()] = {value, expires, true};
+    }
+    ps.endArray();
+}
+
+void ToxResolver::saveCache()
+{
+    QSettings ps(Settings::getInstance().getSettingsDirPath() + "resolverkeys.ini", QSettings::IniFormat);
+    qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+    ps.remove("Entries");
+    ps.beginWriteArray("Entries");
+    int index = 0;
+    for (auto it = cache.begin(); it != cache.end();)
+    {
+        if (it->expires <= now)
+        {
+            it = cache.erase(it);
+            continue;
+        }
+        if (!it->persistent)
+        {
+            ++it;
+            continue;
+        }
+
+        ps.setArrayIndex(index++);
+        ps.setValue("key", it.key());
+        ps.setValue("value", QString::fromLatin1(it->value.toHex()));
+        ps.setValue("expires", it->expires);
+        ++it;
+    }
+    ps.endArray();
+}
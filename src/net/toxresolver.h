@@ -0,0 +1,84 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TOXRESOLVER_H
+#define TOXRESOLVER_H
+
+#include "src/core/toxid.h"
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QFuture>
+#include <QThreadPool>
+#include <functional>
+
+class QObject;
+
+/// Resolves Toxme and Tox DNS addresses to Tox IDs on worker threads
+/// Results are cached in memory until they expire, and concurrent lookups of the same
+/// address share a single request. Only the servers' public keys are kept on disk,
+/// the addresses our user looked up never leave memory.
+/// The class is thread safe
+class ToxResolver
+{
+public:
+    enum Source
+    {
+        UseToxme = 1,
+        UseToxDns = 2,
+        UseAny = UseToxme | UseToxDns
+    };
+
+    /// Resolves the address, then calls back on context's thread with an empty ToxId on failure
+    /// Valid Tox IDs and cached addresses call back right away. Nothing is called if context is deleted first.
+    static void resolve(const QString& address, Source sources, QObject* context, std::function<void(ToxId)> callback);
+
+    /// Returns the cached value of key, or an empty array if it's missing or expired
+    static QByteArray getCached(const QString& key);
+    /// Caches a value for ttl seconds, in the settings dir too if persistent
+    static void setCached(const QString& key, const QByteArray& value, int ttl, bool persistent = false);
+
+    static constexpr int addressTTL = 6*60*60; ///< Owners can change their nospam, don't keep IDs too long
+    static constexpr int pubkeyTTL = 7*24*60*60; ///< Server keys rarely change
+
+private:
+    ToxResolver()=delete;
+    static ToxId lookup(QString address, Source sources);
+    static ToxId getCachedId(const QString& address, Source sources);
+    static void loadCache(); ///< Must be called with the cacheLock held
+    static void saveCache(); ///< Writes the persistent entries, must be called with the cacheLock held
+
+private:
+    struct CacheEntry
+    {
+        QByteArray value;
+        qint64 expires; ///< In seconds since the epoch
+        bool persistent;
+    };
+
+    static QMutex cacheLock;
+    static bool cacheLoaded;
+    static QHash<QString, CacheEntry> cache;
+    static QHash<QString, QFuture<ToxId>> pending; ///< Lookups in flight, by source and address
+    static QThreadPool lookupPool;
+};
+
+#endif // TOXRESOLVER_H
@@ -19,8 +19,7 @@
 
 
 #include "src/net/toxuri.h"
-#include "src/net/toxdns.h"
-#include "src/net/toxme.h"
+#include "src/net/toxresolver.h"
 #include "src/widget/tool/friendrequestdialog.h"
 #include "src/nexus.h"
 #include "src/core/core.h"
@@ -63,22 +62,20 @@ bool handleToxURI(const QString &toxURI)
     else
         toxaddr = toxURI.mid(4);
 
-    QString toxId = Toxme::lookup(toxaddr).toString();
-    if (toxId.isEmpty())
+    ToxResolver::resolve(toxaddr, ToxResolver::UseAny, qApp, [=](ToxId toxId)
     {
-        toxId = ToxDNS::resolveToxAddress(toxaddr, true).toString();
-        if (toxId.isEmpty())
+        if (toxId.toString().isEmpty())
         {
             QMessageBox::warning(0, "qTox", toxaddr + " is not a valid Tox address.");
-            return false;
+            return;
         }
-    }
 
-    ToxURIDialog dialog(0, toxaddr, QObject::tr("%1 here! Tox me maybe?",
-                                                "Default message in Tox URI friend requests. Write something appropriate!")
-                        .arg(Nexus::getCore()->getUsername()));
-    if (dialog.exec() == QDialog::Accepted)
-        Core::getInstance()->requestFriendship(toxId, dialog.getRequestMessage());
+        ToxURIDialog dialog(0, toxaddr, QObject::tr("%1 here! Tox me maybe?",
+                                                    "Default message in Tox URI friend requests. Write something appropriate!")
+                            .arg(Nexus::getCore()->getUsername()));
+        if (dialog.exec() == QDialog::Accepted)
+            Core::getInstance()->requestFriendship(toxId.toString(), dialog.getRequestMessage());
+    });
     return true;
 }
 
@@ -24,7 +24,7 @@
 #include <QDialog>
 
 /// Shows a dialog asking whether or not to add this tox address as a friend
-/// Will wait until the core is ready first
+/// Will wait until the core is ready first, the dialog shows once the address is resolved in the background
 bool handleToxURI(const QString& toxURI);
 
 // Internals
@@ -95,6 +95,7 @@ void Nexus::start()
     qRegisterMetaType<ToxFile>("ToxFile");
     qRegisterMetaType<ToxFile::FileDirection>("ToxFile::FileDirection");
     qRegisterMetaType<std::shared_ptr<VideoFrame>>("std::shared_ptr<VideoFrame>");
+    qRegisterMetaType<QList<History::HistMessage>>("QList<History::HistMessage>");
 
     loginScreen = new LoginScreen();
 
@@ -230,6 +231,7 @@ void Nexus::showMainGUI()
     connect(core, &Core::groupPeerAudioPlaying,      widget, &Widget::onGroupPeerAudioPlaying);
     connect(core, &Core::emptyGroupCreated, widget, &Widget::onEmptyGroupCreated);
     connect(core, &Core::friendTypingChanged, widget, &Widget::onFriendTypingChanged);
+    connect(core, &Core::fileReceiveRequested, widget, &Widget::onFileReceiveRequested);
 
     connect(core, &Core::messageSentResult, widget, &Widget::onMessageSendResult);
     connect(core, &Core::groupSentResult, widget, &Widget::onGroupSendResult);
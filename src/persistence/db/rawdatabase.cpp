@@ -1,9 +1,11 @@
 #include "rawdatabase.h"
+#include "src/persistence/passkeycache.h"
 #include <QDebug>
 #include <QMetaObject>
 #include <QMutexLocker>
 #include <QCoreApplication>
 #include <QFile>
+#include <QTimer>
 #include <cassert>
 #include <tox/toxencryptsave.h>
 
@@ -15,8 +17,14 @@
 #include <sqlcipher/sqlite3.h>
 
 RawDatabase::RawDatabase(const QString &path, const QString& password)
-    : workerThread{new QThread}, path{path}, currentHexKey{deriveKey(password)}
+    : workerThread{new QThread}, path{path}, currentHexKey{deriveKey(password)},
+      statementCache{statementCacheSize}
 {
+    // Created before moving to the worker thread, so that it moves with us
+    groupCommitTimer = new QTimer{this};
+    groupCommitTimer->setSingleShot(true);
+    connect(groupCommitTimer, &QTimer::timeout, this, &RawDatabase::process);
+
     workerThread->setObjectName("qTox Database");
     moveToThread(workerThread.get());
     workerThread->start();
@@ -58,7 +66,7 @@ bool RawDatabase::open(const QString& path, const QString &hexKey)
 
     if (!hexKey.isEmpty())
     {
-        if (!execNow("PRAGMA key = \"x'"+hexKey+"'\""))
+        if (!execNow(uncachedQuery("PRAGMA key = \"x'"+hexKey+"'\"")))
         {
             qWarning() << "Failed to set encryption key";
             close();
@@ -83,6 +91,9 @@ void RawDatabase::close()
     // We assume we're in the ctor or dtor, so we just need to finish processing our transactions
     process();
 
+    // The cached statements must be finalized before the connection can be closed
+    statementCache.clear();
+
     if (sqlite3_close(sqlite) == SQLITE_OK)
         sqlite = nullptr;
     else
@@ -145,21 +156,29 @@ void RawDatabase::execLater(const RawDatabase::Query &statement)
 }
 
 void RawDatabase::execLater(const QVector<RawDatabase::Query> &statements)
+{
+    execLater(statements, {});
+}
+
+void RawDatabase::execLater(const QVector<RawDatabase::Query> &statements, std::function<void(bool)> resultCallback)
 {
     if (!sqlite)
     {
         qWarning() << "Trying to exec, but the database is not open";
+        if (resultCallback)
+            resultCallback(false);
         return;
     }
 
     Transaction trans;
     trans.queries = statements;
+    trans.resultCallback = resultCallback;
     {
         QMutexLocker locker{&transactionsMutex};
         pendingTransactions.enqueue(trans);
     }
 
-    QMetaObject::invokeMethod(this, "process");
+    QMetaObject::invokeMethod(this, "processLater");
 }
 
 void RawDatabase::sync()
@@ -167,6 +186,12 @@ void RawDatabase::sync()
     QMetaObject::invokeMethod(this, "process", Qt::BlockingQueuedConnection);
 }
 
+void RawDatabase::setGroupCommit(int maxTransactions, int delayMs)
+{
+    groupCommitSize.store(qMax(1, maxTransactions), std::memory_order_relaxed);
+    groupCommitDelay.store(qMax(0, delayMs), std::memory_order_relaxed);
+}
+
 bool RawDatabase::setPassword(const QString& password)
 {
     if (!sqlite)
@@ -198,7 +223,7 @@ bool RawDatabase::setPassword(const QString& password)
         QString newHexKey = deriveKey(password);
         if (!currentHexKey.isEmpty())
         {
-            if (!execNow("PRAGMA rekey = \"x'"+newHexKey+"'\""))
+            if (!execNow(uncachedQuery("PRAGMA rekey = \"x'"+newHexKey+"'\"")))
             {
                 qWarning() << "Failed to change encryption key";
                 close();
@@ -208,9 +233,9 @@ bool RawDatabase::setPassword(const QString& password)
         else
         {
             // Need to encrypt the database
-            if (!execNow("ATTACH DATABASE '"+path+".tmp' AS encrypted KEY \"x'"+newHexKey+"'\";"
-                         "SELECT sqlcipher_export('encrypted');"
-                         "DETACH DATABASE encrypted;"))
+            if (!execNow(uncachedQuery("ATTACH DATABASE '"+path+".tmp' AS encrypted KEY \"x'"+newHexKey+"'\";"
+                                       "SELECT sqlcipher_export('encrypted');"
+                                       "DETACH DATABASE encrypted;")))
             {
                 qWarning() << "Failed to export encrypted database";
                 close();
@@ -236,9 +261,9 @@ bool RawDatabase::setPassword(const QString& password)
             return true;
 
         // Need to decrypt the database
-        if (!execNow("ATTACH DATABASE '"+path+".tmp' AS plaintext KEY '';"
-                     "SELECT sqlcipher_export('plaintext');"
-                     "DETACH DATABASE plaintext;"))
+        if (!execNow(uncachedQuery("ATTACH DATABASE '"+path+".tmp' AS plaintext KEY '';"
+                                   "SELECT sqlcipher_export('plaintext');"
+                                   "DETACH DATABASE plaintext;")))
         {
             qWarning() << "Failed to export decrypted database";
             close();
@@ -317,13 +342,10 @@ QString RawDatabase::deriveKey(QString password)
     if (password.isEmpty())
         return {};
 
-    QByteArray passData = password.toUtf8();
-
     static_assert(TOX_PASS_KEY_LENGTH >= 32, "toxcore must provide 256bit or longer keys");
 
     static const uint8_t expandConstant[TOX_PASS_SALT_LENGTH+1] = "L'ignorance est le pire des maux";
-    TOX_PASS_KEY key;
-    tox_derive_key_with_salt((uint8_t*)passData.data(), passData.size(), expandConstant, &key, nullptr);
+    TOX_PASS_KEY key = PasskeyCache::getKey(password, expandConstant);
     return QByteArray((char*)key.key, 32).toHex();
 }
 
@@ -334,130 +356,301 @@ void RawDatabase::process()
     if (!sqlite)
         return;
 
+    // We process everything now, there's no point waiting for more transactions to group
+    groupCommitTimer->stop();
+
     forever
     {
-        // Fetch the next transaction
-        Transaction trans;
+        // Fetch the next transactions
+        QVector<Transaction> batch;
         {
             QMutexLocker locker{&transactionsMutex};
             if (pendingTransactions.isEmpty())
                 return;
-            trans = pendingTransactions.dequeue();
+            batch += pendingTransactions.dequeue();
+
+            // Consecutive asynchronous transactions share a single commit and journal sync
+            const int maxGroupSize = groupCommitSize.load(std::memory_order_relaxed);
+            while (batch.size() < maxGroupSize && isGroupable(batch.first())
+                   && !pendingTransactions.isEmpty() && isGroupable(pendingTransactions.head()))
+                batch += pendingTransactions.dequeue();
         }
 
         // In case we exit early, prepare to signal errors
-        if (trans.success != nullptr)
-            trans.success->store(false, std::memory_order_release);
+        for (const Transaction& trans : batch)
+            if (trans.success != nullptr)
+                trans.success->store(false, std::memory_order_release);
+
+        // Execute each transaction in order
+        const bool grouped = batch.size() > 1;
+        QVector<bool> results(batch.size(), false);
+        QVector<QVector<PendingInsert>> inserts(batch.size());
+        QVector<PendingInsert> groupInserts;
+        bool ok = !grouped || execQuery({"BEGIN;"}, groupInserts);
+        for (int i=0; ok && i<batch.size(); ++i)
+        {
+            results[i] = execTransaction(batch[i], grouped, inserts[i]);
+
+            // Some errors make sqlite roll back the whole transaction, and the group with it
+            if (!results[i] && grouped && sqlite3_get_autocommit(sqlite))
+                ok = false;
+        }
+        if (ok && grouped)
+            ok = execQuery({"COMMIT;"}, groupInserts);
 
-        // Add transaction commands if necessary
-        if (trans.queries.size() > 1)
+        if (!ok)
         {
-            trans.queries.prepend({"BEGIN;"});
-            trans.queries.append({"COMMIT;"});
+            qWarning() << "Group commit of"<<batch.size()<<"transactions failed";
+            if (!sqlite3_get_autocommit(sqlite))
+                sqlite3_exec(sqlite, "ROLLBACK;", nullptr, nullptr, nullptr);
+            results.fill(false);
         }
 
-        // Compile queries
-        for (Query& query : trans.queries)
+        // Signal transaction results, now that they are committed
+        for (int i=0; i<batch.size(); ++i)
         {
-            assert(query.statements.isEmpty());
-            // sqlite3_prepare_v2 only compiles one statement at a time in the query, we need to loop over them all
-            int curParam=0;
-            const char* compileTail = query.query.data();
-            do {
-                // Compile the next statement
-                sqlite3_stmt* stmt;
-                int r;
-                if ((r = sqlite3_prepare_v2(sqlite, compileTail,
-                                       query.query.size() - static_cast<int>(compileTail - query.query.data()),
-                                       &stmt, &compileTail)) != SQLITE_OK)
-                {
-                    qWarning() << "Failed to prepare statement"<<query.query<<"with error"<<r;
-                    goto cleanupStatements;
-                }
-                query.statements += stmt;
+            const Transaction& trans = batch[i];
+            if (results[i])
+                for (const PendingInsert& insert : inserts[i])
+                    insert.callback(insert.rowid);
+
+            if (trans.success != nullptr)
+                trans.success->store(results[i], std::memory_order_release);
+            if (trans.done != nullptr)
+                trans.done->store(true, std::memory_order_release);
+            if (trans.resultCallback)
+                trans.resultCallback(results[i]);
+        }
+    }
+}
 
-                // Now we can bind our params to this statement
-                int nParams = sqlite3_bind_parameter_count(stmt);
-                if (query.blobs.size() < curParam+nParams)
-                {
-                    qWarning() << "Not enough parameters to bind to query "<<query.query;
-                    goto cleanupStatements;
-                }
-                for (int i=0; i<nParams; ++i)
-                {
-                    const QByteArray& blob = query.blobs[curParam+i];
-                    if (sqlite3_bind_blob(stmt, i+1, blob.data(), blob.size(), SQLITE_STATIC) != SQLITE_OK)
-                    {
-                        qWarning() << "Failed to bind param"<<curParam+i<<"to query "<<query.query;
-                        goto cleanupStatements;
-                    }
-                }
-                curParam += nParams;
-            } while (compileTail != query.query.data()+query.query.size());
+void RawDatabase::processLater()
+{
+    assert(QThread::currentThread() == workerThread.get());
+
+    const int maxGroupSize = groupCommitSize.load(std::memory_order_relaxed);
+    const int delay = groupCommitDelay.load(std::memory_order_relaxed);
+    int pending;
+    {
+        QMutexLocker locker{&transactionsMutex};
+        pending = pendingTransactions.size();
+    }
+
+    if (maxGroupSize <= 1 || delay <= 0 || pending >= maxGroupSize)
+        process();
+    else if (!groupCommitTimer->isActive())
+        groupCommitTimer->start(delay);
+}
+
+bool RawDatabase::execTransaction(const Transaction& trans, bool inGroup, QVector<PendingInsert>& inserts)
+{
+    // In a group commit each transaction gets a savepoint, so that a failure only rolls back its own queries
+    const bool wrapped = inGroup || trans.queries.size() > 1;
+    if (wrapped && !execQuery({inGroup ? "SAVEPOINT grouped;" : "BEGIN;"}, inserts))
+        return false;
+
+    bool ok = true;
+    for (const Query& query : trans.queries)
+    {
+        if (!execQuery(query, inserts))
+        {
+            ok = false;
+            break;
         }
+    }
+
+    if (ok && wrapped)
+        ok = execQuery({inGroup ? "RELEASE grouped;" : "COMMIT;"}, inserts);
+
+    if (!ok)
+    {
+        inserts.clear();
 
-        // Execute each statement of each query of our transaction
-        for (Query& query : trans.queries)
+        // Don't leave a failed transaction open, or every following BEGIN would fail too
+        if (!sqlite3_get_autocommit(sqlite))
         {
-            for (sqlite3_stmt* stmt : query.statements)
+            qWarning() << "Rolling back failed transaction";
+            if (inGroup)
+                sqlite3_exec(sqlite, "ROLLBACK TO grouped; RELEASE grouped;", nullptr, nullptr, nullptr);
+            else
+                sqlite3_exec(sqlite, "ROLLBACK;", nullptr, nullptr, nullptr);
+        }
+    }
+
+    return ok;
+}
+
+bool RawDatabase::isGroupable(const Transaction& trans)
+{
+    return trans.success == nullptr && trans.done == nullptr;
+}
+
+RawDatabase::CompiledQuery* RawDatabase::compile(const QByteArray& query)
+{
+    std::unique_ptr<CompiledQuery> compiled{new CompiledQuery};
+
+    // sqlite3_prepare_v2 only compiles one statement at a time in the query, we need to loop over them all
+    const char* compileTail = query.data();
+    do {
+        // Compile the next statement
+        sqlite3_stmt* stmt;
+        int r;
+        if ((r = sqlite3_prepare_v2(sqlite, compileTail,
+                               query.size() - static_cast<int>(compileTail - query.data()),
+                               &stmt, &compileTail)) != SQLITE_OK)
+        {
+            qWarning() << "Failed to prepare statement"<<query<<"with error"<<r;
+            return nullptr;
+        }
+        // Trailing whitespace and comments compile to a null statement
+        if (stmt)
+            compiled->statements += stmt;
+    } while (compileTail != query.data()+query.size());
+
+    return compiled.release();
+}
+
+bool RawDatabase::execQuery(const Query& query, QVector<PendingInsert>& inserts)
+{
+    // Statements are checked out of the cache while in use, so a query repeated
+    // in the same transaction simply reuses them after the previous execution
+    std::unique_ptr<CompiledQuery> compiled{statementCache.take(query.query)};
+    if (!compiled)
+    {
+        compiled.reset(compile(query.query));
+        if (!compiled)
+            return false;
+    }
+
+    bool ok = true;
+    int curParam=0;
+    for (sqlite3_stmt* stmt : compiled->statements)
+    {
+        // Bind our params to this statement
+        int nParams = sqlite3_bind_parameter_count(stmt);
+        if (query.params.size() < curParam+nParams)
+        {
+            qWarning() << "Not enough parameters to bind to query "<<query.query;
+            ok = false;
+            break;
+        }
+        for (int i=0; i<nParams; ++i)
+        {
+            if (bindParam(stmt, i+1, query.params[curParam+i]) != SQLITE_OK)
             {
-                int column_count = sqlite3_column_count(stmt);
-                int result;
-                do {
-                    result = sqlite3_step(stmt);
-
-                    // Execute our row callback
-                    if (result == SQLITE_ROW && query.rowCallback)
-                    {
-                        QVector<QVariant> row;
-                        for (int i=0; i<column_count; ++i)
-                            row += extractData(stmt, i);
-
-                        query.rowCallback(row);
-                    }
-                } while (result == SQLITE_ROW);
-                if (result == SQLITE_ERROR)
-                {
-                    qWarning() << "Error executing query "<<query.query;
-                    goto cleanupStatements;
-                }
-                else if (result == SQLITE_MISUSE)
-                {
-                    qWarning() << "Misuse executing query "<<query.query;
-                    goto cleanupStatements;
-                }
-                else if (result == SQLITE_CONSTRAINT)
-                {
-                    qWarning() << "Constraint error executing query "<<query.query;
-                    goto cleanupStatements;
-                }
-                else if (result != SQLITE_DONE)
-                {
-                    qWarning() << "Unknown error"<<result<<"executing query "<<query.query;
-                    goto cleanupStatements;
-                }
+                qWarning() << "Failed to bind param"<<curParam+i<<"to query "<<query.query;
+                ok = false;
+                break;
             }
+        }
+        curParam += nParams;
+
+        // Execute the statement
+        int result = SQLITE_DONE;
+        if (ok)
+        {
+            int column_count = sqlite3_column_count(stmt);
+            do {
+                result = sqlite3_step(stmt);
+                if (result != SQLITE_ROW)
+                    break;
 
-            if (query.insertCallback)
-                query.insertCallback(sqlite3_last_insert_rowid(sqlite));
+                // Execute our row callbacks
+                if (query.rowCallback)
+                {
+                    QVector<QVariant> row;
+                    row.reserve(column_count);
+                    for (int i=0; i<column_count; ++i)
+                        row += extractData(stmt, i);
+
+                    query.rowCallback(row);
+                }
+                if (query.typedRowCallback)
+                    query.typedRowCallback(Row{stmt});
+            } while (true);
         }
 
-        if (trans.success != nullptr)
-            trans.success->store(true, std::memory_order_release);
+        // Make the statement ready for its next use, and don't keep pointers to the params
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+
+        if (!ok)
+            break;
 
-        // Free our statements
-        cleanupStatements:
-        for (Query& query : trans.queries)
+        if (result == SQLITE_ERROR)
+        {
+            qWarning() << "Error executing query "<<query.query<<":"<<sqlite3_errmsg(sqlite);
+            ok = false;
+        }
+        else if (result == SQLITE_MISUSE)
+        {
+            qWarning() << "Misuse executing query "<<query.query;
+            ok = false;
+        }
+        else if (result == SQLITE_CONSTRAINT)
         {
-            for (sqlite3_stmt* stmt : query.statements)
-                sqlite3_finalize(stmt);
-            query.statements.clear();
+            qWarning() << "Constraint error executing query "<<query.query;
+            ok = false;
+        }
+        else if (result != SQLITE_DONE)
+        {
+            qWarning() << "Unknown error"<<result<<"executing query "<<query.query;
+            ok = false;
         }
 
-        // Signal transaction results
-        if (trans.done != nullptr)
-            trans.done->store(true, std::memory_order_release);
+        if (!ok)
+            break;
     }
+
+    if (ok && query.insertCallback)
+        inserts += PendingInsert{query.insertCallback, sqlite3_last_insert_rowid(sqlite)};
+
+    if (query.cacheable)
+        statementCache.insert(query.query, compiled.release());
+
+    return ok;
+}
+
+RawDatabase::Query RawDatabase::uncachedQuery(const QString& statement)
+{
+    Query query{statement};
+    query.cacheable = false;
+    return query;
+}
+
+RawDatabase::CompiledQuery::~CompiledQuery()
+{
+    for (sqlite3_stmt* stmt : statements)
+        sqlite3_finalize(stmt);
+}
+
+int RawDatabase::Row::columnCount() const
+{
+    return sqlite3_column_count(stmt);
+}
+
+bool RawDatabase::Row::isNull(int col) const
+{
+    return sqlite3_column_type(stmt, col) == SQLITE_NULL;
+}
+
+int64_t RawDatabase::Row::getInt64(int col) const
+{
+    return sqlite3_column_int64(stmt, col);
+}
+
+QString RawDatabase::Row::getString(int col) const
+{
+    const char* str = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+    int len = sqlite3_column_bytes(stmt, col);
+    return QString::fromUtf8(str, len);
+}
+
+QByteArray RawDatabase::Row::getBlob(int col) const
+{
+    const char* data = reinterpret_cast<const char*>(sqlite3_column_blob(stmt, col));
+    int len = sqlite3_column_bytes(stmt, col);
+    return QByteArray(data, len);
 }
 
 QVariant RawDatabase::extractData(sqlite3_stmt *stmt, int col)
@@ -484,3 +677,36 @@ QVariant RawDatabase::extractData(sqlite3_stmt *stmt, int col)
         return QByteArray::fromRawData(data, len);
     }
 }
+
+int RawDatabase::bindParam(sqlite3_stmt *stmt, int index, const QVariant &param)
+{
+    switch (static_cast<QMetaType::Type>(param.type()))
+    {
+    case QMetaType::UnknownType:
+        return sqlite3_bind_null(stmt, index);
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        return sqlite3_bind_int64(stmt, index, param.toLongLong());
+    case QMetaType::Double:
+        return sqlite3_bind_double(stmt, index, param.toDouble());
+    case QMetaType::QString:
+    {
+        QByteArray str = param.toString().toUtf8();
+        return sqlite3_bind_text(stmt, index, str.constData(), str.size(), SQLITE_TRANSIENT);
+    }
+    case QMetaType::QByteArray:
+    {
+        // The copy shares its data with the param, which outlives the statement's execution
+        const QByteArray blob = param.toByteArray();
+        return sqlite3_bind_blob(stmt, index, blob.constData(), blob.size(), SQLITE_STATIC);
+    }
+    default:
+    {
+        QByteArray blob = param.toByteArray();
+        return sqlite3_bind_blob(stmt, index, blob.constData(), blob.size(), SQLITE_TRANSIENT);
+    }
+    }
+}
@@ -9,11 +9,14 @@
 #include <QPair>
 #include <QMutex>
 #include <QVariant>
+#include <QCache>
 #include <memory>
 #include <atomic>
+#include <functional>
 
 struct sqlite3;
 struct sqlite3_stmt;
+class QTimer;
 
 /// Implements a low level RAII interface to a SQLCipher (SQlite3) database
 /// Thread-safe, does all database operations on a worker thread
@@ -23,25 +26,49 @@ class RawDatabase : QObject
     Q_OBJECT
 
 public:
+    /// A typed view of the current result row of a query, only valid during the row callback
+    /// Reads the columns directly from the statement, without boxing every value in a QVariant
+    class Row
+    {
+    public:
+        int columnCount() const;
+        bool isNull(int col) const;
+        int64_t getInt64(int col) const;
+        QString getString(int col) const; ///< Reads a TEXT or BLOB column as UTF-8
+        QByteArray getBlob(int col) const;
+
+    private:
+        explicit Row(sqlite3_stmt* stmt) : stmt{stmt} {}
+        sqlite3_stmt* stmt;
+
+        friend class RawDatabase;
+    };
+
     /// A query to be executed by the database. Can be composed of one or more SQL statements in the query,
-    /// optional BLOB parameters to be bound, and callbacks fired when the query is executed
+    /// optional parameters to be bound, and callbacks fired when the query is executed
+    /// Parameters are bound by type: integers as INTEGER, QString as TEXT, QByteArray as BLOB, null as NULL
     /// Calling any database method from a query callback is undefined behavior
     class Query
     {
     public:
-        Query(QString query, QVector<QByteArray> blobs = {}, std::function<void(int64_t)> insertCallback={})
-            : query{query.toUtf8()}, blobs{blobs}, insertCallback{insertCallback} {}
+        Query(QString query, QVector<QVariant> params = {}, std::function<void(int64_t)> insertCallback={})
+            : query{query.toUtf8()}, params{params}, insertCallback{insertCallback} {}
         Query(QString query, std::function<void(int64_t)> insertCallback)
             : query{query.toUtf8()}, insertCallback{insertCallback} {}
         Query(QString query, std::function<void(const QVector<QVariant>&)> rowCallback)
             : query{query.toUtf8()}, rowCallback{rowCallback} {}
+        Query(QString query, QVector<QVariant> params, std::function<void(const Row&)> typedRowCallback)
+            : query{query.toUtf8()}, params{params}, typedRowCallback{typedRowCallback} {}
+        Query(QString query, std::function<void(const Row&)> typedRowCallback)
+            : query{query.toUtf8()}, typedRowCallback{typedRowCallback} {}
         Query() = default;
     private:
         QByteArray query; ///< UTF-8 query string
-        QVector<QByteArray> blobs; ///< Bound data blobs
+        QVector<QVariant> params; ///< Bound parameters
         std::function<void(int64_t)> insertCallback; ///< Called after execution with the last insert rowid
         std::function<void(const QVector<QVariant>&)> rowCallback; ///< Called during execution for each row
-        QVector<sqlite3_stmt*> statements; ///< Statements to be compiled from the query
+        std::function<void(const Row&)> typedRowCallback; ///< Called during execution for each row
+        bool cacheable = true; ///< Whether the compiled statements may be kept in the statement cache
 
         friend class RawDatabase;
     };
@@ -62,8 +89,14 @@ public:
     void execLater(const QString& statement);
     void execLater(const Query& statement);
     void execLater(const QVector<Query>& statements);
+    /// Executes a SQL transaction asynchronously, then calls resultCallback on the worker thread
+    /// with whether the transaction was successful
+    void execLater(const QVector<Query>& statements, std::function<void(bool)> resultCallback);
     /// Waits until all the pending transactions are executed
     void sync();
+    /// Commits up to maxTransactions asynchronous transactions at once, waiting up to delayMs for more of them
+    /// Each transaction still succeeds or fails on its own. A maxTransactions of 1 disables grouping
+    void setGroupCommit(int maxTransactions, int delayMs);
 
 public slots:
     /// Changes the database password, encrypting or decrypting if necessary
@@ -86,12 +119,40 @@ protected slots:
     /// Unqueues, compiles, binds and executes queries, then notifies of results
     /// MUST only be called from the worker thread
     void process();
+    /// Processes the pending transactions now, or once enough of them can be grouped in a single commit
+    void processLater();
 
 protected:
     /// Derives a 256bit key from the password and returns it hex-encoded
     static QString deriveKey(QString password);
     /// Extracts a variant from one column of a result row depending on the column type
     static QVariant extractData(sqlite3_stmt* stmt, int col);
+    /// Binds a variant to a statement parameter depending on the variant type
+    static int bindParam(sqlite3_stmt* stmt, int index, const QVariant& param);
+    /// Returns a query that will never be kept in the statement cache, for statements holding secrets
+    static Query uncachedQuery(const QString& statement);
+
+private:
+    /// The compiled statements of a query, finalized when destroyed
+    struct CompiledQuery
+    {
+        ~CompiledQuery();
+        QVector<sqlite3_stmt*> statements;
+    };
+
+    /// An insert callback waiting for its transaction to be committed
+    struct PendingInsert
+    {
+        std::function<void(int64_t)> callback;
+        int64_t rowid;
+    };
+
+    /// Compiles all the statements of a UTF-8 query, returns nullptr on failure
+    CompiledQuery* compile(const QByteArray& query);
+    /// Binds, executes and resets the statements of a single query, reusing cached statements
+    /// The insert callback is added to inserts instead of being called
+    /// MUST only be called from the worker thread
+    bool execQuery(const Query& query, QVector<PendingInsert>& inserts);
 
 private:
     /// SQL transactions to be processed
@@ -103,8 +164,15 @@ private:
         std::atomic_bool* success = nullptr;
         /// If not a nullptr, will be set to true when the transaction has been executed
         std::atomic_bool* done = nullptr;
+        /// If set, called with the result once the transaction has been executed
+        std::function<void(bool)> resultCallback;
     };
 
+    /// Executes the queries of a transaction, in a savepoint if it's part of a group commit
+    bool execTransaction(const Transaction& trans, bool inGroup, QVector<PendingInsert>& inserts);
+    /// Asynchronous transactions have no one waiting on them, so they can be grouped
+    static bool isGroupable(const Transaction& trans);
+
 private:
     sqlite3* sqlite;
     std::unique_ptr<QThread> workerThread;
@@ -113,6 +181,14 @@ private:
     QMutex transactionsMutex;
     QString path;
     QString currentHexKey;
+    /// Compiled statements by UTF-8 query text, only touched from the worker thread
+    QCache<QByteArray, CompiledQuery> statementCache;
+    static constexpr int statementCacheSize = 128;
+    /// Group commit settings, see setGroupCommit
+    std::atomic_int groupCommitSize{1};
+    std::atomic_int groupCommitDelay{0};
+    /// Fires at the end of the group commit delay window, lives on the worker thread
+    QTimer* groupCommitTimer;
 };
 
 #endif // RAWDATABASE_H
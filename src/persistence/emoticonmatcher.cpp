@@ -0,0 +1,126 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "emoticonmatcher.h"
+#include <QMap>
+#include <algorithm>
+
+EmoticonMatcher::EmoticonMatcher(const QStringList& emoticons)
+{
+    // Build a trie with ordered children first, then flatten it breadth-first
+    // so that the edges of each node end up contiguous and sorted
+    QVector<QMap<ushort, int>> children(1);
+    QVector<bool> terminal(1, false);
+    for (const QString& emoticon : emoticons)
+    {
+        if (emoticon.isEmpty())
+            continue;
+
+        int node = 0;
+        for (QChar c : emoticon)
+        {
+            int next = children[node].value(c.unicode(), -1);
+            if (next < 0)
+            {
+                next = children.size();
+                children[node].insert(c.unicode(), next);
+                children.append(QMap<ushort, int>());
+                terminal.append(false);
+            }
+            node = next;
+        }
+        terminal[node] = true;
+    }
+
+    QVector<int> order{0}; // trie nodes in breadth-first order
+    QVector<int> index(children.size()); // trie node -> index in nodes
+    for (int i = 0; i < order.size(); ++i)
+    {
+        index[order[i]] = i;
+        for (int child : children[order[i]])
+            order.append(child);
+    }
+
+    nodes.reserve(order.size());
+    for (int trieNode : order)
+    {
+        const QMap<ushort, int>& nodeChildren = children[trieNode];
+        nodes.append({edges.size(), nodeChildren.size(), terminal[trieNode]});
+        for (auto it = nodeChildren.begin(); it != nodeChildren.end(); ++it)
+            edges.append({it.key(), index[it.value()]});
+    }
+}
+
+QVector<EmoticonMatcher::Match> EmoticonMatcher::match(const QString& text) const
+{
+    QVector<Match> matches;
+    const QChar* data = text.constData();
+    const int size = text.size();
+
+    int i = 0;
+    while (i < size)
+    {
+        if (data[i].isSpace())
+        {
+            ++i;
+            continue;
+        }
+
+        // Walk the word through the trie, it's an emoticon if it ends on a terminal node
+        int start = i;
+        int node = 0;
+        for (; i < size && !data[i].isSpace(); ++i)
+        {
+            if (node >= 0)
+                node = step(node, data[i]);
+        }
+
+        if (node >= 0 && nodes[node].terminal)
+            matches.append({start, i - start});
+    }
+
+    return matches;
+}
+
+bool EmoticonMatcher::matches(const QStringRef& word) const
+{
+    if (word.isEmpty())
+        return false;
+
+    const QChar* data = word.unicode();
+    int node = 0;
+    for (int i = 0; i < word.size() && node >= 0; ++i)
+        node = step(node, data[i]);
+
+    return node >= 0 && nodes[node].terminal;
+}
+
+int EmoticonMatcher::step(int node, QChar c) const
+{
+    const Node& n = nodes[node];
+    auto begin = edges.constBegin() + n.firstEdge;
+    auto end = begin + n.edgeCount;
+    auto it = std::lower_bound(begin, end, c.unicode(),
+                               [](const QPair<ushort, int>& edge, ushort ch) { return edge.first < ch; });
+
+    if (it == end || it->first != c.unicode())
+        return -1;
+
+    return it->second;
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EMOTICONMATCHER_H
+#define EMOTICONMATCHER_H
+
+#include <QString>
+#include <QStringRef>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+
+/// Finds the words of a text that are emoticons, in a single pass over the text
+/// The emoticons are compiled into a trie when constructed, the matcher is immutable
+/// afterwards, so it can be shared between threads without locking.
+class EmoticonMatcher
+{
+public:
+    struct Match
+    {
+        int pos;
+        int length;
+    };
+
+public:
+    explicit EmoticonMatcher(const QStringList& emoticons);
+
+    /// Returns the whitespace-delimited words of text that are emoticons, in order
+    QVector<Match> match(const QString& text) const;
+    /// Returns true if the whole word is an emoticon
+    bool matches(const QStringRef& word) const;
+
+private:
+    /// Returns the node reached from node with c, or -1
+    int step(int node, QChar c) const;
+
+private:
+    struct Node
+    {
+        int firstEdge; ///< Edges of a node are contiguous in edges, sorted by character
+        int edgeCount;
+        bool terminal; ///< An emoticon ends here
+    };
+
+    QVector<Node> nodes; ///< The root is nodes[0]
+    QVector<QPair<ushort, int>> edges; ///< Character and target node
+};
+
+#endif // EMOTICONMATCHER_H
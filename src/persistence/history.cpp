@@ -5,12 +5,15 @@
 #include "src/persistence/historykeeper.h"
 #include <QDebug>
 #include <cassert>
+#include <memory>
 
 using namespace std;
 
 History::History(const QString &profileName, const QString &password)
     : db{getDbPath(profileName), password}
 {
+    // Bursts of messages are saved in group commits, with a single journal sync for all of them
+    db.setGroupCommit(GROUP_COMMIT_SIZE, GROUP_COMMIT_DELAY);
     init();
 }
 
@@ -49,11 +52,12 @@ void History::remove()
 
 void History::eraseHistory()
 {
-    db.execNow("DELETE FROM faux_offline_pending;"
-               "DELETE FROM history;"
-               "DELETE FROM aliases;"
-               "DELETE FROM peers;"
-               "VACUUM;");
+    db.execNow(QString(searchEnabled ? "INSERT INTO history_fts (history_fts) VALUES ('delete-all');" : "")
+               + "DELETE FROM faux_offline_pending;"
+                 "DELETE FROM history;"
+                 "DELETE FROM aliases;"
+                 "DELETE FROM peers;"
+                 "VACUUM;");
 }
 
 void History::removeFriendHistory(const QString &friendPk)
@@ -62,16 +66,29 @@ void History::removeFriendHistory(const QString &friendPk)
         return;
     int64_t id = peers[friendPk];
 
-    if (db.execNow(QString("DELETE FROM faux_offline_pending "
-               "WHERE faux_offline_pending.id IN ( "
-                 "SELECT faux_offline_pending.id FROM faux_offline_pending "
-                 "LEFT JOIN history ON faux_offline_pending.id = history.id "
-                 "WHERE chat_id=%1 "
-               "); "
-               "DELETE FROM history WHERE chat_id=%1; "
-               "DELETE FROM aliases WHERE owner=%1; "
-               "DELETE FROM peers WHERE id=%1; "
-               "VACUUM;").arg(id)))
+    // The search index only holds tokens, it needs the messages to know what to remove
+    QString query;
+    QVector<QVariant> params;
+    if (searchEnabled)
+    {
+        query += "INSERT INTO history_fts (history_fts, rowid, message) "
+                 "SELECT 'delete', id, message FROM history WHERE chat_id=?; ";
+        params += qint64(id);
+    }
+
+    query += "DELETE FROM faux_offline_pending "
+             "WHERE faux_offline_pending.id IN ( "
+               "SELECT faux_offline_pending.id FROM faux_offline_pending "
+               "LEFT JOIN history ON faux_offline_pending.id = history.id "
+               "WHERE chat_id=? "
+             "); "
+             "DELETE FROM history WHERE chat_id=?; "
+             "DELETE FROM aliases WHERE owner=?; "
+             "DELETE FROM peers WHERE id=?; "
+             "VACUUM;";
+    params += {qint64(id), qint64(id), qint64(id), qint64(id)};
+
+    if (db.execNow({query, params}))
     {
         peers.remove(friendPk);
     }
@@ -100,7 +117,7 @@ QVector<RawDatabase::Query> History::generateNewMessageQueries(const QString &fr
         else
             peerId = *max_element(begin(peers), end(peers))+1;
         peers[friendPk] = peerId;
-        queries += RawDatabase::Query{("INSERT INTO peers (id, public_key) VALUES (%1, '"+friendPk+"');").arg(peerId)};
+        queries += RawDatabase::Query{"INSERT INTO peers (id, public_key) VALUES (?, ?);", {qint64(peerId), friendPk}};
     }
 
     // Get the db id of the sender of the message
@@ -116,26 +133,31 @@ QVector<RawDatabase::Query> History::generateNewMessageQueries(const QString &fr
         else
             senderId = *max_element(begin(peers), end(peers))+1;
         peers[sender] = senderId;
-        queries += RawDatabase::Query{("INSERT INTO peers (id, public_key) VALUES (%1, '"+sender+"');").arg(senderId)};
+        queries += RawDatabase::Query{"INSERT INTO peers (id, public_key) VALUES (?, ?);", {qint64(senderId), sender}};
     }
 
-    queries += RawDatabase::Query(QString("INSERT OR IGNORE INTO aliases (owner, display_name) VALUES (%1, ?);")
-                                  .arg(senderId), {dispName.toUtf8()});
+    queries += RawDatabase::Query("INSERT OR IGNORE INTO aliases (owner, display_name) VALUES (?, ?);",
+                                  {qint64(senderId), dispName.toUtf8()});
 
     // If the alias already existed, the insert will ignore the conflict and last_insert_rowid() will return garbage,
     // so we have to check changes() and manually fetch the row ID in this case
-    queries += RawDatabase::Query(QString("INSERT INTO history (timestamp, chat_id, message, sender_alias) "
-                                          "VALUES (%1, %2, ?, ("
-                                          "  CASE WHEN changes() IS 0 THEN ("
-                                          "    SELECT id FROM aliases WHERE owner=%3 AND display_name=?)"
-                                          "  ELSE last_insert_rowid() END"
-                                          "));")
-                                    .arg(time.toMSecsSinceEpoch()).arg(peerId).arg(senderId),
-                                    {message.toUtf8(), dispName.toUtf8()}, insertIdCallback);
+    queries += RawDatabase::Query("INSERT INTO history (timestamp, chat_id, message, sender_alias) "
+                                  "VALUES (?, ?, ?, ("
+                                  "  CASE WHEN changes() IS 0 THEN ("
+                                  "    SELECT id FROM aliases WHERE owner=? AND display_name=?)"
+                                  "  ELSE last_insert_rowid() END"
+                                  "));",
+                                  {time.toMSecsSinceEpoch(), qint64(peerId), message.toUtf8(),
+                                   qint64(senderId), dispName.toUtf8()}, insertIdCallback);
 
     if (!isSent)
         queries += RawDatabase::Query{"INSERT INTO faux_offline_pending (id) VALUES (last_insert_rowid());"};
 
+    // The faux_offline_pending id is the history id, so last_insert_rowid() is still the message's
+    if (searchEnabled)
+        queries += RawDatabase::Query{"INSERT INTO history_fts (rowid, message) VALUES (last_insert_rowid(), ?);",
+                                      {message.toUtf8()}};
+
     return queries;
 }
 
@@ -149,34 +171,160 @@ QList<History::HistMessage> History::getChatHistory(const QString &friendPk, con
 {
     QList<HistMessage> messages;
 
-    auto rowCallback = [&messages](const QVector<QVariant>& row)
+    // We never saved anything for a friend that isn't in our peers table
+    if (!peers.contains(friendPk))
+        return messages;
+    int64_t chatId = peers[friendPk];
+
+    auto rowCallback = [&messages, &friendPk](const RawDatabase::Row& row)
     {
         // dispName and message could have null bytes, QString::fromUtf8 truncates on null bytes so we strip them
-        messages += {row[0].toLongLong(),
-                    row[1].isNull(),
-                    QDateTime::fromMSecsSinceEpoch(row[2].toLongLong()),
-                    row[3].toString(),
-                    QString::fromUtf8(row[4].toByteArray().replace('\0',"")),
-                    row[5].toString(),
-                    QString::fromUtf8(row[6].toByteArray().replace('\0',""))};
+        messages += {row.getInt64(0),
+                    row.isNull(1),
+                    QDateTime::fromMSecsSinceEpoch(row.getInt64(2)),
+                    friendPk,
+                    QString::fromUtf8(row.getBlob(3).replace('\0',"")),
+                    row.getString(4),
+                    QString::fromUtf8(row.getBlob(5).replace('\0',""))};
     };
 
+    // This is a range scan of the (chat_id, timestamp) index, which also yields the rows in order
     // Don't forget to update the rowCallback if you change the selected columns!
-    db.execNow({QString("SELECT history.id, faux_offline_pending.id, timestamp, chat.public_key, "
-                               "aliases.display_name, sender.public_key, message FROM history "
-                       "LEFT JOIN faux_offline_pending ON history.id = faux_offline_pending.id "
-                       "JOIN peers chat ON chat_id = chat.id "
-                       "JOIN aliases ON sender_alias = aliases.id "
-                       "JOIN peers sender ON aliases.owner = sender.id "
-                       "WHERE timestamp BETWEEN %1 AND %2 AND chat.public_key='%3';")
-                        .arg(from.toMSecsSinceEpoch()).arg(to.toMSecsSinceEpoch()).arg(friendPk), rowCallback});
+    db.execNow({"SELECT history.id, faux_offline_pending.id, timestamp, "
+                       "aliases.display_name, sender.public_key, message FROM history "
+                "LEFT JOIN faux_offline_pending ON history.id = faux_offline_pending.id "
+                "JOIN aliases ON sender_alias = aliases.id "
+                "JOIN peers sender ON aliases.owner = sender.id "
+                "WHERE chat_id = ? AND timestamp BETWEEN ? AND ? "
+                "ORDER BY timestamp, history.id;",
+                {qint64(chatId), from.toMSecsSinceEpoch(), to.toMSecsSinceEpoch()}, rowCallback});
+
+    return messages;
+}
+
+QList<History::HistMessage> History::getChatHistoryPage(const QString &friendPk, const QDateTime &beforeTime,
+                                                        qint64 beforeId, int count)
+{
+    QList<HistMessage> messages;
+    if (!peers.contains(friendPk))
+        return messages;
+
+    db.execNow(generatePageQuery(peers[friendPk], friendPk, beforeTime, beforeId, count, messages));
+    return messages;
+}
+
+void History::fetchChatHistoryPage(const QString &friendPk, const QDateTime &beforeTime, qint64 beforeId, int count,
+                                   std::function<void(QList<HistMessage>)> callback)
+{
+    if (!peers.contains(friendPk))
+    {
+        callback({});
+        return;
+    }
+
+    // The rows are collected on the database thread, and handed to the callback once the query is done
+    auto messages = std::make_shared<QList<HistMessage>>();
+    db.execLater({generatePageQuery(peers[friendPk], friendPk, beforeTime, beforeId, count, *messages)},
+                 [messages, callback](bool)
+    {
+        callback(*messages);
+    });
+}
+
+QHash<QString, History::ChatSummary> History::getChatSummaries()
+{
+    QHash<QString, ChatSummary> summaries;
+
+    auto rowCallback = [&summaries](const RawDatabase::Row& row)
+    {
+        ChatSummary& summary = summaries[row.getString(0)];
+        summary.latest = QDateTime::fromMSecsSinceEpoch(row.getInt64(1));
+        summary.unsent = row.getInt64(2);
+    };
+
+    // One aggregate over the (chat_id, timestamp) index, instead of a history query per friend
+    db.execNow({"SELECT peers.public_key, MAX(timestamp), COUNT(faux_offline_pending.id) FROM history "
+                "LEFT JOIN faux_offline_pending ON history.id = faux_offline_pending.id "
+                "JOIN peers ON chat_id = peers.id "
+                "GROUP BY chat_id;", rowCallback});
+
+    return summaries;
+}
+
+RawDatabase::Query History::generatePageQuery(int64_t chatId, const QString &friendPk, const QDateTime &beforeTime,
+                                              qint64 beforeId, int count, QList<HistMessage> &messages)
+{
+    auto rowCallback = [&messages, friendPk](const RawDatabase::Row& row)
+    {
+        // Rows come newest first, so prepending puts them back in chronological order
+        messages.prepend({row.getInt64(0),
+                          row.isNull(1),
+                          QDateTime::fromMSecsSinceEpoch(row.getInt64(2)),
+                          friendPk,
+                          QString::fromUtf8(row.getBlob(3).replace('\0',"")),
+                          row.getString(4),
+                          QString::fromUtf8(row.getBlob(5).replace('\0',""))});
+    };
+
+    // Keyset pagination: a backward range scan of the (chat_id, timestamp) index that stops after count rows,
+    // so the cost of a page doesn't depend on how far back in the history it is
+    // Don't forget to update the rowCallback if you change the selected columns!
+    return {"SELECT history.id, faux_offline_pending.id, timestamp, "
+                   "aliases.display_name, sender.public_key, message FROM history "
+            "LEFT JOIN faux_offline_pending ON history.id = faux_offline_pending.id "
+            "JOIN aliases ON sender_alias = aliases.id "
+            "JOIN peers sender ON aliases.owner = sender.id "
+            "WHERE chat_id = ?1 AND timestamp <= ?2 AND NOT (timestamp = ?2 AND history.id >= ?3) "
+            "ORDER BY timestamp DESC, history.id DESC LIMIT ?4;",
+            {qint64(chatId), beforeTime.toMSecsSinceEpoch(), beforeId, count}, rowCallback};
+}
+
+QList<History::HistMessage> History::search(const QString &friendPk, const QString &text, int limit, int cursor)
+{
+    QList<HistMessage> messages;
+    if (!searchEnabled || !peers.contains(friendPk))
+        return messages;
+
+    // Every word is quoted, so that user input is never parsed as FTS query syntax
+    QStringList terms;
+    for (QString word : text.split(' ', QString::SkipEmptyParts))
+        terms += '"' + word.replace('"', "\"\"") + '"';
+    if (terms.isEmpty())
+        return messages;
+
+    auto rowCallback = [&messages, &friendPk](const RawDatabase::Row& row)
+    {
+        messages += {row.getInt64(0),
+                    row.isNull(1),
+                    QDateTime::fromMSecsSinceEpoch(row.getInt64(2)),
+                    friendPk,
+                    QString::fromUtf8(row.getBlob(3).replace('\0',"")),
+                    row.getString(4),
+                    QString::fromUtf8(row.getBlob(5).replace('\0',""))};
+    };
+
+    // Don't forget to update the rowCallback if you change the selected columns!
+    db.execNow({"SELECT history.id, faux_offline_pending.id, history.timestamp, "
+                       "aliases.display_name, sender.public_key, history.message FROM history_fts "
+                "JOIN history ON history.id = history_fts.rowid "
+                "LEFT JOIN faux_offline_pending ON history.id = faux_offline_pending.id "
+                "JOIN aliases ON sender_alias = aliases.id "
+                "JOIN peers sender ON aliases.owner = sender.id "
+                "WHERE history_fts MATCH ? AND history.chat_id = ? "
+                "ORDER BY history_fts.rank LIMIT ? OFFSET ?;",
+                {terms.join(' '), qint64(peers[friendPk]), limit, cursor}, rowCallback});
 
     return messages;
 }
 
 void History::markAsSent(qint64 id)
 {
-    db.execLater(QString("DELETE FROM faux_offline_pending WHERE id=%1;").arg(id));
+    db.execLater({"DELETE FROM faux_offline_pending WHERE id=?;", {id}});
+}
+
+void History::sync()
+{
+    db.sync();
 }
 
 QString History::getDbPath(const QString &profileName)
@@ -200,11 +348,104 @@ void History::init()
                                                      "message BLOB NOT NULL);"
                  "CREATE TABLE IF NOT EXISTS faux_offline_pending (id INTEGER PRIMARY KEY);");
 
-    // Cache our current peers
-    db.execLater(RawDatabase::Query{"SELECT public_key, id FROM peers;", [this](const QVector<QVariant>& row)
+    upgradeSchema();
+    initSearchIndex();
+
+    // Cache our current peers, synchronously so that lookups never race with the worker thread
+    db.execNow(RawDatabase::Query{"SELECT public_key, id FROM peers;", [this](const RawDatabase::Row& row)
+    {
+        peers[row.getString(0)] = row.getInt64(1);
+    }});
+}
+
+void History::upgradeSchema()
+{
+    int64_t version = 0;
+    db.execNow(RawDatabase::Query{"PRAGMA user_version;", [&version](const RawDatabase::Row& row)
+    {
+        version = row.getInt64(0);
+    }});
+
+    if (version >= SCHEMA_VERSION)
+        return;
+
+    qDebug() << "Upgrading history schema from version"<<version<<"to"<<SCHEMA_VERSION;
+    QVector<RawDatabase::Query> queries;
+
+    // Version 1: index the history by chat, so loading a chat is a range scan instead of a full table scan
+    if (version < 1)
+        queries += RawDatabase::Query{"CREATE INDEX IF NOT EXISTS history_chat_id_timestamp "
+                                      "ON history (chat_id, timestamp);"};
+
+    queries += RawDatabase::Query{QString("PRAGMA user_version = %1;").arg(SCHEMA_VERSION)};
+    db.execLater(queries);
+}
+
+void History::initSearchIndex()
+{
+    bool exists = false;
+    db.execNow(RawDatabase::Query{"SELECT name FROM sqlite_master WHERE type='table' AND name='history_fts';",
+                                  [&exists](const RawDatabase::Row&)
+    {
+        exists = true;
+    }});
+
+    if (!exists)
+    {
+        // The index reads the messages from the history table, so the rebuild indexes our existing history
+        qDebug() << "Creating the history search index";
+        if (!db.execNow({RawDatabase::Query{"CREATE VIRTUAL TABLE history_fts USING fts5"
+                                            "(message, content='history', content_rowid='id');"},
+                         RawDatabase::Query{"INSERT INTO history_fts (history_fts) VALUES ('rebuild');"}}))
+        {
+            qWarning() << "Failed to create the history search index, is SQLCipher built with FTS5?";
+            return;
+        }
+    }
+    else if (!db.execNow("SELECT rowid FROM history_fts LIMIT 0;"))
+    {
+        // Our SQLCipher can't use the index, we'd fail to save every message if we tried to maintain it.
+        // The messages we save meanwhile aren't indexed, so a build that can use it must rebuild it
+        qWarning() << "The history search index is unusable, is SQLCipher built with FTS5?";
+        db.execNow("CREATE TABLE IF NOT EXISTS history_fts_stale (unused INTEGER);");
+        return;
+    }
+    else if (isSearchIndexStale())
+    {
+        qDebug() << "Rebuilding the history search index";
+        if (!db.execNow({RawDatabase::Query{"INSERT INTO history_fts (history_fts) VALUES ('rebuild');"},
+                         RawDatabase::Query{"DROP TABLE IF EXISTS history_fts_stale;"}}))
+        {
+            qWarning() << "Failed to rebuild the history search index";
+            return;
+        }
+    }
+
+    searchEnabled = true;
+}
+
+bool History::isSearchIndexStale()
+{
+    bool marked = false;
+    db.execNow(RawDatabase::Query{"SELECT name FROM sqlite_master WHERE type='table' AND name='history_fts_stale';",
+                                  [&marked](const RawDatabase::Row&)
+    {
+        marked = true;
+    }});
+    if (marked)
+        return true;
+
+    // Each indexed message has a row in the index's docsize table,
+    // so any message saved or deleted without the index shows up here
+    bool stale = false;
+    db.execNow(RawDatabase::Query{"SELECT (SELECT count(*) FROM history_fts_docsize), "
+                                  "(SELECT ifnull(max(id), 0) FROM history_fts_docsize), "
+                                  "(SELECT count(*) FROM history), (SELECT ifnull(max(id), 0) FROM history);",
+                                  [&stale](const RawDatabase::Row& row)
     {
-        peers[row[0].toString()] = row[1].toInt();
+        stale = row.getInt64(0) != row.getInt64(2) || row.getInt64(1) != row.getInt64(3);
     }});
+    return stale;
 }
 
 void History::import(const HistoryKeeper &oldHistory)
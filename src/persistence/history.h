@@ -18,6 +18,7 @@ class History
 public:
     struct HistMessage
     {
+        HistMessage() = default;
         HistMessage(qint64 id, bool isSent, QDateTime timestamp, QString chat, QString dispName, QString sender, QString message) :
             chat{chat}, sender{sender}, message{message}, dispName{dispName}, timestamp{timestamp}, id{id}, isSent{isSent} {}
 
@@ -26,8 +27,15 @@ public:
         QString message;
         QString dispName;
         QDateTime timestamp;
-        qint64 id;
-        bool isSent;
+        qint64 id = 0;
+        bool isSent = true;
+    };
+
+    /// What the contact list needs to know about a chat, without loading its messages
+    struct ChatSummary
+    {
+        QDateTime latest; ///< Timestamp of the newest message, invalid if there are none
+        int unsent = 0; ///< Number of messages still waiting to be delivered
     };
 
 public:
@@ -59,21 +67,50 @@ public:
                        std::function<void(int64_t)> insertIdCallback={});
     /// Fetches chat messages from the database
     QList<HistMessage> getChatHistory(const QString& friendPk, const QDateTime &from, const QDateTime &to);
+    /// Fetches the count messages preceding the message (beforeTime, beforeId), in chronological order
+    /// Pass the timestamp of the oldest message already shown and its id, or an id of 0 for all messages before a date
+    QList<HistMessage> getChatHistoryPage(const QString& friendPk, const QDateTime& beforeTime, qint64 beforeId,
+                                          int count);
+    /// Same as getChatHistoryPage, but returns immediately and calls the callback on the database thread
+    void fetchChatHistoryPage(const QString& friendPk, const QDateTime& beforeTime, qint64 beforeId, int count,
+                              std::function<void(QList<HistMessage>)> callback);
+    /// Fetches the summary of every chat in a single query, indexed by friend public key
+    QHash<QString, ChatSummary> getChatSummaries();
+    /// Waits until all the pending history operations are done
+    void sync();
+    /// Searches the chat history with a friend, returns up to limit messages, best matches first
+    /// Pass the number of results already fetched as the cursor to get the next ones
+    QList<HistMessage> search(const QString& friendPk, const QString& text, int limit, int cursor = 0);
     /// Marks a message as sent, removing it from the faux-offline pending messages list
     void markAsSent(qint64 id);
 
 protected:
     /// Makes sure the history tables are created
     void init();
+    /// Migrates an existing database to the current schema version
+    void upgradeSchema();
+    /// Creates the full-text search index if needed, search is disabled if that's not possible
+    void initSearchIndex();
+    /// Returns true if messages were saved or deleted while the search index couldn't be maintained
+    bool isSearchIndexStale();
     static QString getDbPath(const QString& profileName);
+    /// Returns a query appending the messages it selects to messages, the caller must keep it alive
+    static RawDatabase::Query generatePageQuery(int64_t chatId, const QString& friendPk, const QDateTime& beforeTime,
+                                                qint64 beforeId, int count, QList<HistMessage>& messages);
     QVector<RawDatabase::Query> generateNewMessageQueries(const QString& friendPk, const QString& message,
                                     const QString& sender, const QDateTime &time, bool isSent, QString dispName,
                                                           std::function<void(int64_t)> insertIdCallback={});
 
 private:
+    /// Stored in the database's user_version, bump it and add a step to upgradeSchema to change the schema
+    static constexpr int64_t SCHEMA_VERSION = 1;
+    /// Up to this many asynchronous writes are committed at once, waiting at most this many ms for them
+    static constexpr int GROUP_COMMIT_SIZE = 256;
+    static constexpr int GROUP_COMMIT_DELAY = 20;
     RawDatabase db;
     // Cached mappings to speed up message saving
     QHash<QString, int64_t> peers; ///< Maps friend public keys to unique IDs by index
+    bool searchEnabled = false; ///< Whether the history_fts search index is available and maintained
 };
 
 #endif // HISTORY_H
@@ -0,0 +1,121 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "passkeycache.h"
+#include "src/core/core.h"
+#include <QDebug>
+#include <cstring>
+#include <sodium.h>
+
+QMutex PasskeyCache::cacheLock;
+QString PasskeyCache::cachedPassword;
+TOX_PASS_KEY* PasskeyCache::keys{nullptr};
+int PasskeyCache::keyCount{0};
+int PasskeyCache::writeKey{-1};
+
+void PasskeyCache::setPassword(const QString& password)
+{
+    QMutexLocker locker(&cacheLock);
+    if (password == cachedPassword)
+        return;
+
+    if (keys)
+        sodium_memzero(keys, maxKeys * sizeof(TOX_PASS_KEY));
+    keyCount = 0;
+    writeKey = -1;
+    cachedPassword = password;
+}
+
+TOX_PASS_KEY PasskeyCache::getKey(const QString& password, const uint8_t* salt)
+{
+    QMutexLocker locker(&cacheLock);
+    if (password.isEmpty() || password != cachedPassword)
+        return *Core::createPasskey(password, const_cast<uint8_t*>(salt));
+
+    int index = findKey(salt);
+    if (index >= 0)
+        return keys[index];
+
+    TOX_PASS_KEY key = *Core::createPasskey(password, const_cast<uint8_t*>(salt));
+    addKey(key);
+    return key;
+}
+
+bool PasskeyCache::getKeyForData(const QString& password, const QByteArray& data, TOX_PASS_KEY& key)
+{
+    uint8_t salt[TOX_PASS_SALT_LENGTH];
+    if (data.size() < TOX_PASS_ENCRYPTION_EXTRA_LENGTH
+            || !tox_get_salt(reinterpret_cast<uint8_t*>(const_cast<char*>(data.data())), salt))
+        return false;
+
+    key = getKey(password, salt);
+    sodium_memzero(salt, sizeof(salt));
+    return true;
+}
+
+TOX_PASS_KEY PasskeyCache::getWriteKey(const QString& password)
+{
+    QMutexLocker locker(&cacheLock);
+    if (password.isEmpty() || password != cachedPassword)
+        return *Core::createPasskey(password);
+
+    if (writeKey < 0 && keyCount > 0)
+        writeKey = 0;
+    if (writeKey >= 0)
+        return keys[writeKey];
+
+    TOX_PASS_KEY key = *Core::createPasskey(password);
+    writeKey = addKey(key);
+    return key;
+}
+
+int PasskeyCache::findKey(const uint8_t* salt)
+{
+    for (int i=0; i<keyCount; ++i)
+        if (!memcmp(keys[i].salt, salt, TOX_PASS_SALT_LENGTH))
+            return i;
+    return -1;
+}
+
+int PasskeyCache::addKey(const TOX_PASS_KEY& key)
+{
+    if (!keys)
+    {
+        if (sodium_init() < 0)
+        {
+            qCritical() << "Failed to initialize libsodium, not caching derived keys";
+            return -1;
+        }
+        keys = static_cast<TOX_PASS_KEY*>(sodium_allocarray(maxKeys, sizeof(TOX_PASS_KEY)));
+        if (!keys)
+        {
+            qWarning() << "Couldn't allocate locked memory, not caching derived keys";
+            return -1;
+        }
+    }
+
+    if (keyCount >= maxKeys)
+    {
+        qDebug() << "Derived key cache is full, not caching key";
+        return -1;
+    }
+
+    keys[keyCount] = key;
+    return keyCount++;
+}
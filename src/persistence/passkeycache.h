@@ -0,0 +1,65 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PASSKEYCACHE_H
+#define PASSKEYCACHE_H
+
+#include <QMutex>
+#include <QString>
+#include <tox/toxencryptsave.h>
+
+/// Caches the keys derived from the current profile's password, indexed by salt
+/// The KDF is deliberately slow, and every file encrypted with the same salt can share
+/// a single derivation. The profile writes all its files with one salt, so loading an
+/// encrypted profile with many avatars costs one KDF run instead of one per file.
+/// Keys are kept in memory locked with sodium_malloc, and wiped when the password changes.
+/// Keys for any other password are derived on demand and never cached.
+/// All methods are thread-safe.
+class PasskeyCache
+{
+public:
+    /// Sets the password of the current profile, wiping the keys derived from the previous one
+    /// Setting the same password again keeps the cached keys.
+    static void setPassword(const QString& password);
+    /// Returns the key derived from the password and this salt of TOX_PASS_SALT_LENGTH bytes
+    static TOX_PASS_KEY getKey(const QString& password, const uint8_t* salt);
+    /// Returns the key to decrypt data produced by tox_pass_key_encrypt
+    /// Returns false if the data doesn't carry a salt.
+    static bool getKeyForData(const QString& password, const QByteArray& data, TOX_PASS_KEY& key);
+    /// Returns the key the profile encrypts the files it writes with
+    /// The salt of the first cached key is reused, Profile::loadProfile caches the salt of the .tox save
+    /// first. If there is none yet, the key is derived with a new random salt.
+    static TOX_PASS_KEY getWriteKey(const QString& password);
+
+private:
+    PasskeyCache()=delete;
+    /// Returns the index of the cached key with this salt, or -1. Must be called with the lock held.
+    static int findKey(const uint8_t* salt);
+    /// Caches the key if there is room left. Must be called with the lock held.
+    static int addKey(const TOX_PASS_KEY& key);
+
+private:
+    static constexpr int maxKeys = 16;
+    static QMutex cacheLock;
+    static QString cachedPassword;
+    static TOX_PASS_KEY* keys; ///< maxKeys slots allocated with sodium_allocarray
+    static int keyCount;
+    static int writeKey; ///< Index of the key used to write files, or -1
+};
+
+#endif // PASSKEYCACHE_H
@@ -20,6 +20,7 @@
 
 #include "profile.h"
 #include "profilelocker.h"
+#include "passkeycache.h"
 #include "src/persistence/settings.h"
 #include "src/persistence/historykeeper.h"
 #include "src/core/core.h"
@@ -33,16 +34,21 @@
 #include <QThread>
 #include <QObject>
 #include <QDebug>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QFutureWatcher>
 #include <sodium.h>
 
 QVector<QString> Profile::profiles;
 
 Profile::Profile(QString name, QString password, bool isNewProfile)
     : name{name}, password{password},
-      newProfile{isNewProfile}, isRemoved{false}
+      newProfile{isNewProfile}, isRemoved{false},
+      savePending{false}, pendingSaveEncrypted{false}, saveRunning{false},
+      avatarImages{maxAvatarImagesCost}
 {
+    PasskeyCache::setPassword(password);
     if (!password.isEmpty())
-        passkey = *core->createPasskey(password);
+        passkey = PasskeyCache::getWriteKey(password);
 
     Settings& s = Settings::getInstance();
     s.setCurrentProfile(name);
@@ -117,11 +123,14 @@ Profile* Profile::loadProfile(QString name, QString password)
                 return nullptr;
             }
 
-            uint8_t salt[TOX_PASS_SALT_LENGTH];
-            tox_get_salt(reinterpret_cast<uint8_t *>(data.data()), salt);
-            auto tmpkey = *Core::createPasskey(password, salt);
+            // The salt of the .tox save becomes the one this profile writes all its files with
+            PasskeyCache::setPassword(password);
+            TOX_PASS_KEY tmpkey;
+            if (PasskeyCache::getKeyForData(password, data, tmpkey))
+                data = Core::decryptData(data, tmpkey);
+            else
+                data.clear();
 
-            data = Core::decryptData(data, tmpkey);
             if (data.isEmpty())
             {
                 qCritical() << "Failed to decrypt the tox save file";
@@ -172,6 +181,7 @@ Profile::~Profile()
         saveToxSave();
     delete core;
     delete coreThread;
+    flushToxSave();
     if (!isRemoved)
     {
         Settings::getInstance().savePersonal(this);
@@ -180,6 +190,7 @@ Profile::~Profile()
         assert(ProfileLocker::getCurLockName() == name);
         ProfileLocker::unlock();
     }
+    PasskeyCache::setPassword(QString());
 }
 
 QVector<QString> Profile::getFilesByExt(QString extension)
@@ -277,11 +288,11 @@ QByteArray Profile::loadToxSave()
             goto fail;
         }
 
-        uint8_t salt[TOX_PASS_SALT_LENGTH];
-        tox_get_salt(reinterpret_cast<uint8_t *>(data.data()), salt);
-        passkey = *core->createPasskey(password, salt);
+        if (PasskeyCache::getKeyForData(password, data, passkey))
+            data = core->decryptData(data, passkey);
+        else
+            data.clear();
 
-        data = core->decryptData(data, passkey);
         if (data.isEmpty())
             qCritical() << "Failed to decrypt the tox save file";
     }
@@ -306,34 +317,92 @@ void Profile::saveToxSave()
 
 void Profile::saveToxSave(QByteArray data)
 {
-    assert(!isRemoved);
+    if (isRemoved)
+    {
+        qWarning() << "Not saving the tox save of removed profile"<<name;
+        return;
+    }
     ProfileLocker::assertLock();
     assert(ProfileLocker::getCurLockName() == name);
 
-    QString path = Settings::getInstance().getSettingsDirPath() + name + ".tox";
+    QMutexLocker locker(&saveLock);
+    pendingSave = data;
+    pendingSavePath = Settings::getInstance().getSettingsDirPath() + name + ".tox";
+    pendingSaveEncrypted = !password.isEmpty();
+    if (pendingSaveEncrypted)
+        pendingSaveKey = passkey;
+    savePending = true;
+    newProfile = false;
+
+    if (!saveRunning)
+    {
+        saveRunning = true;
+        QtConcurrent::run(this, &Profile::writeToxSaves);
+    }
+}
+
+void Profile::flushToxSave()
+{
+    QMutexLocker locker(&saveLock);
+    while (saveRunning)
+        saveDone.wait(&saveLock);
+}
+
+void Profile::writeToxSaves()
+{
+    forever
+    {
+        QByteArray data;
+        QString path;
+        TOX_PASS_KEY key;
+        bool encrypted;
+        {
+            QMutexLocker locker(&saveLock);
+            if (!savePending)
+            {
+                saveRunning = false;
+                saveDone.wakeAll();
+                return;
+            }
+            savePending = false;
+            data = pendingSave;
+            pendingSave.clear();
+            path = pendingSavePath;
+            encrypted = pendingSaveEncrypted;
+            key = pendingSaveKey;
+        }
+
+        writeToxSave(path, data, encrypted ? &key : nullptr);
+    }
+}
+
+bool Profile::writeToxSave(const QString& path, QByteArray data, const TOX_PASS_KEY* key)
+{
     qDebug() << "Saving tox save to "<<path;
     QSaveFile saveFile(path);
     if (!saveFile.open(QIODevice::WriteOnly))
     {
         qCritical() << "Tox save file " << path << " couldn't be opened";
-        return;
+        return false;
     }
 
-    if (!password.isEmpty())
+    if (key)
     {
-        passkey = *core->createPasskey(password);
-        data = core->encryptData(data, passkey);
+        data = Core::encryptData(data, *key);
         if (data.isEmpty())
         {
             qCritical() << "Failed to encrypt, can't save!";
             saveFile.cancelWriting();
-            return;
+            return false;
         }
     }
 
-    saveFile.write(data);
-    saveFile.commit();
-    newProfile = false;
+    if (saveFile.write(data) != data.size() || !saveFile.commit())
+    {
+        qCritical() << "Failed to write the tox save file" << path;
+        return false;
+    }
+    return true;
 }
 
 QString Profile::avatarPath(const QString &ownerId, bool forceUnencrypted)
@@ -360,9 +429,15 @@ QPixmap Profile::loadAvatar()
 
 QPixmap Profile::loadAvatar(const QString &ownerId)
 {
-    QPixmap pic;
-    pic.loadFromData(loadAvatarData(ownerId));
-    return pic;
+    {
+        QMutexLocker locker(&avatarLock);
+        if (QImage* image = avatarImages.object(ownerId))
+            return QPixmap::fromImage(*image);
+    }
+
+    QImage image = QImage::fromData(loadAvatarData(ownerId));
+    cacheAvatarImage(ownerId, image);
+    return QPixmap::fromImage(image);
 }
 
 QByteArray Profile::loadAvatarData(const QString &ownerId)
@@ -372,14 +447,18 @@ QByteArray Profile::loadAvatarData(const QString &ownerId)
 
 QByteArray Profile::loadAvatarData(const QString &ownerId, const QString &password)
 {
-    QString path = avatarPath(ownerId);
+    return readAvatarFile(avatarPath(ownerId), avatarPath(ownerId, true), password);
+}
+
+QByteArray Profile::readAvatarFile(QString path, const QString& plainPath, const QString& password)
+{
     bool encrypted = !password.isEmpty();
 
     // If the encrypted avatar isn't found, try loading the unencrypted one for the same ID
     if (!password.isEmpty() && !QFile::exists(path))
     {
         encrypted = false;
-        path = avatarPath(ownerId, true);
+        path = plainPath;
     }
 
     QFile file(path);
@@ -389,16 +468,82 @@ QByteArray Profile::loadAvatarData(const QString &ownerId, const QString &passwo
     QByteArray pic = file.readAll();
     if (encrypted && !pic.isEmpty())
     {
-        uint8_t salt[TOX_PASS_SALT_LENGTH];
-        tox_get_salt(reinterpret_cast<uint8_t *>(pic.data()), salt);
-        auto passkey = core->createPasskey(password, salt);
-        pic = core->decryptData(pic, *passkey);
+        TOX_PASS_KEY key;
+        if (!PasskeyCache::getKeyForData(password, pic, key))
+            return {};
+
+        pic = Core::decryptData(pic, key);
     }
     return pic;
 }
 
+void Profile::loadAvatarAsync(const QString& ownerId, QObject* context, std::function<void(QPixmap)> callback)
+{
+    {
+        QMutexLocker locker(&avatarLock);
+        if (QImage* image = avatarImages.object(ownerId))
+        {
+            callback(QPixmap::fromImage(*image));
+            return;
+        }
+    }
+
+    // The paths need our own ID from toxcore, so they're computed here rather than on the worker
+    QString path = avatarPath(ownerId), plainPath = avatarPath(ownerId, true), pass = password;
+    int version = getAvatarVersion(ownerId);
+    auto watcher = new QFutureWatcher<QImage>(context);
+    QObject::connect(watcher, &QFutureWatcher<QImage>::finished, context, [=]()
+    {
+        QImage image = watcher->result();
+        watcher->deleteLater();
+        // A newer avatar was saved while we were loading this one
+        if (getAvatarVersion(ownerId) != version)
+            return;
+
+        cacheAvatarImage(ownerId, image);
+        callback(QPixmap::fromImage(image));
+    });
+    watcher->setFuture(QtConcurrent::run([=]()
+    {
+        return QImage::fromData(readAvatarFile(path, plainPath, pass));
+    }));
+}
+
+int Profile::getAvatarVersion(const QString& ownerId)
+{
+    QMutexLocker locker(&avatarLock);
+    return avatarVersions.value(ownerId);
+}
+
+void Profile::cacheAvatarImage(const QString& ownerId, const QImage& image)
+{
+    QMutexLocker locker(&avatarLock);
+    avatarImages.insert(ownerId, new QImage(image), qMax(1, image.byteCount() / 1024));
+}
+
+void Profile::avatarChanged(const QString& ownerId, const QByteArray& pic)
+{
+    {
+        QMutexLocker locker(&avatarLock);
+        avatarImages.remove(ownerId);
+        ++avatarVersions[ownerId];
+    }
+
+    // Our own avatar is never offered to us, only our friends' are indexed
+    if (ownerId != core->getSelfId().publicKey)
+        Settings::getInstance().setFriendAvatarHash(ownerId, hashAvatar(pic));
+}
+
+QByteArray Profile::hashAvatar(const QByteArray& pic)
+{
+    QByteArray avatarHash(TOX_HASH_LENGTH, 0);
+    tox_hash((uint8_t*)avatarHash.data(), (const uint8_t*)pic.data(), pic.size());
+    return avatarHash;
+}
+
 void Profile::saveAvatar(QByteArray pic, const QString &ownerId)
 {
+    avatarChanged(ownerId, pic);
     if (!password.isEmpty() && !pic.isEmpty())
         pic = core->encryptData(pic, passkey);
 
@@ -423,9 +568,13 @@ void Profile::saveAvatar(QByteArray pic, const QString &ownerId)
 
 QByteArray Profile::getAvatarHash(const QString &ownerId)
 {
-    QByteArray pic = loadAvatarData(ownerId);
-    QByteArray avatarHash(TOX_HASH_LENGTH, 0);
-    tox_hash((uint8_t*)avatarHash.data(), (uint8_t*)pic.data(), pic.size());
+    QByteArray avatarHash = Settings::getInstance().getFriendAvatarHash(ownerId);
+    if (avatarHash.isEmpty())
+    {
+        // Avatars cached before we kept the index are hashed once, then indexed
+        avatarHash = hashAvatar(loadAvatarData(ownerId));
+        Settings::getInstance().setFriendAvatarHash(ownerId, avatarHash);
+    }
     return avatarHash;
 }
 
@@ -446,6 +595,7 @@ History *Profile::getHistory()
 
 void Profile::removeAvatar(const QString &ownerId)
 {
+    avatarChanged(ownerId, QByteArray());
     QFile::remove(avatarPath(ownerId));
     if (ownerId == core->getSelfId().publicKey)
         core->setAvatar({});
@@ -487,6 +637,7 @@ void Profile::remove()
         return;
     }
     isRemoved = true;
+    flushToxSave();
 
     qDebug() << "Removing profile"<<name;
     for (int i=0; i<profiles.size(); i++)
@@ -519,6 +670,7 @@ bool Profile::rename(QString newName)
     if (!ProfileLocker::lock(newName))
         return false;
 
+    flushToxSave();
     QFile::rename(path+".tox", newPath+".tox");
     QFile::rename(path+".ini", newPath+".ini");
     if (history)
@@ -561,10 +713,22 @@ void Profile::restartCore()
 
 void Profile::setPassword(QString newPassword)
 {
+    // Load the avatars while the keys of the old password are still cached
     QByteArray avatar = loadAvatarData(core->getSelfId().publicKey);
-    QString oldPassword = password;
-    password = newPassword;
-    passkey = *core->createPasskey(password);
+    QVector<QPair<QString, QByteArray>> friendAvatars;
+    for (uint32_t friendId : core->getFriendList())
+    {
+        QString friendPublicKey = core->getFriendPublicKey(friendId);
+        friendAvatars.append({friendPublicKey, loadAvatarData(friendPublicKey)});
+    }
+
+    PasskeyCache::setPassword(newPassword);
+    TOX_PASS_KEY newPasskey = PasskeyCache::getWriteKey(newPassword);
+    {
+        QMutexLocker locker(&saveLock);
+        password = newPassword;
+        passkey = newPasskey;
+    }
     saveToxSave();
 
     if (history)
@@ -574,11 +738,6 @@ void Profile::setPassword(QString newPassword)
     }
     saveAvatar(avatar, core->getSelfId().publicKey);
 
-    QVector<uint32_t> friendList = core->getFriendList();
-    QVectorIterator<uint32_t> i(friendList);
-    while (i.hasNext())
-    {
-        QString friendPublicKey = core->getFriendPublicKey(i.next());
-        saveAvatar(loadAvatarData(friendPublicKey,oldPassword),friendPublicKey);
-    }
+    for (const QPair<QString, QByteArray>& friendAvatar : friendAvatars)
+        saveAvatar(friendAvatar.second, friendAvatar.first);
 }
@@ -25,12 +25,18 @@
 #include <QString>
 #include <QByteArray>
 #include <QPixmap>
+#include <QImage>
+#include <QCache>
+#include <QMutex>
+#include <QWaitCondition>
 #include <tox/toxencryptsave.h>
 #include <memory>
+#include <functional>
 #include "src/persistence/history.h"
 
 class Core;
 class QThread;
+class QObject;
 
 /// Manages user profiles
 class Profile
@@ -59,14 +65,19 @@ public:
 
     QByteArray loadToxSave(); ///< Loads the profile's .tox save from file, unencrypted
     void saveToxSave(); ///< Saves the profile's .tox save, encrypted if needed. Invalid on deleted profiles.
-    void saveToxSave(QByteArray data); ///< Write the .tox save, encrypted if needed. Invalid on deleted profiles.
+    void saveToxSave(QByteArray data); ///< Queues the .tox save to be encrypted if needed and written on a worker thread
+    void flushToxSave(); ///< Blocks until all the queued .tox saves have been written
 
     QPixmap loadAvatar(); ///< Get our avatar from cache
     QPixmap loadAvatar(const QString& ownerId); ///< Get a contact's avatar from cache
     QByteArray loadAvatarData(const QString& ownerId); ///< Get a contact's avatar from cache
     QByteArray loadAvatarData(const QString& ownerId, const QString& password); ///< Get a contact's avatar from cache, with a specified profile password.
     void saveAvatar(QByteArray pic, const QString& ownerId); ///< Save an avatar to cache
-    QByteArray getAvatarHash(const QString& ownerId); ///< Get the tox hash of a cached avatar
+    /// Reads, decrypts and decodes the avatar on a worker thread, then calls back on context's thread
+    /// Calls back right away if the avatar is in the decoded cache. Nothing is called if context is deleted first.
+    void loadAvatarAsync(const QString& ownerId, QObject* context, std::function<void(QPixmap)> callback);
+    /// Get the tox hash of a cached avatar, from the index kept in the personal settings
+    QByteArray getAvatarHash(const QString& ownerId);
     void removeAvatar(const QString& ownerId); ///< Removes a cached avatar
     void removeAvatar(); ///< Removes our own avatar
 
@@ -102,6 +113,17 @@ private:
     /// Gets the path of the avatar file cached by this profile and corresponding to this owner ID
     /// If forceUnencrypted, we return the path to the plaintext file even if we're an encrypted profile
     QString avatarPath(const QString& ownerId, bool forceUnencrypted = false);
+    /// Reads and decrypts an avatar file, falling back to the unencrypted plainPath if path doesn't exist
+    static QByteArray readAvatarFile(QString path, const QString& plainPath, const QString& password);
+    /// Drops the decoded avatar and updates the hash index, pic is the new unencrypted avatar
+    void avatarChanged(const QString& ownerId, const QByteArray& pic);
+    int getAvatarVersion(const QString& ownerId);
+    void cacheAvatarImage(const QString& ownerId, const QImage& image);
+    static QByteArray hashAvatar(const QByteArray& pic);
+    /// Writes the queued .tox saves until none are left, runs on a worker thread
+    void writeToxSaves();
+    /// Encrypts the data with the key if not null, then atomically replaces the file at path
+    static bool writeToxSave(const QString& path, QByteArray data, const TOX_PASS_KEY* key);
 
 private:
     Core* core;
@@ -112,6 +134,17 @@ private:
     bool newProfile; ///< True if this is a newly created profile, with no .tox save file yet.
     bool isRemoved; ///< True if the profile has been removed by remove()
     static QVector<QString> profiles;
+    /// Protects the queued save and the passkey, which the save worker reads
+    QMutex saveLock;
+    QWaitCondition saveDone;
+    QByteArray pendingSave; ///< Only the latest queued save is kept, older ones are superseded
+    QString pendingSavePath;
+    TOX_PASS_KEY pendingSaveKey;
+    bool savePending, pendingSaveEncrypted, saveRunning;
+    QMutex avatarLock;
+    QCache<QString, QImage> avatarImages; ///< Decoded avatars, the cost is in KiB
+    QHash<QString, int> avatarVersions; ///< Bumped on every change, so stale background loads are dropped
+    static constexpr int maxAvatarImagesCost = 32*1024;
     /// How much data we need to read to check if the file is encrypted
     /// Must be >= TOX_ENC_SAVE_MAGIC_LENGTH (8), which isn't publicly defined
     static constexpr int encryptHeaderSize = 8;
@@ -318,6 +318,7 @@ void Settings::loadPersonal(Profile* profile)
 
             if (getEnableLogging())
                 fp.activity = ps.value("activity", QDate()).toDate();
+            fp.avatarHash = QByteArray::fromHex(ps.value("avatarHash").toString().toLatin1());
 
             friendLst[ToxId(fp.addr).publicKey] = fp;
         }
@@ -494,6 +495,7 @@ void Settings::savePersonal(QString profileName, QString password)
 
             if (getEnableLogging())
                 ps.setValue("activity", frnd.activity);
+            ps.setValue("avatarHash", QString::fromLatin1(frnd.avatarHash.toHex()));
 
             index++;
         }
@@ -1395,6 +1397,33 @@ void Settings::setFriendActivity(const ToxId &id, const QDate &activity)
     }
 }
 
+QByteArray Settings::getFriendAvatarHash(const QString& publicKey) const
+{
+    QMutexLocker locker{&bigLock};
+    auto it = friendLst.find(publicKey);
+    if (it != friendLst.end())
+        return it->avatarHash;
+
+    return QByteArray();
+}
+
+void Settings::setFriendAvatarHash(const QString& publicKey, const QByteArray& hash)
+{
+    QMutexLocker locker{&bigLock};
+    auto it = friendLst.find(publicKey);
+    if (it != friendLst.end())
+    {
+        it->avatarHash = hash;
+    }
+    else
+    {
+        friendProp fp;
+        fp.addr = publicKey;
+        fp.avatarHash = hash;
+        friendLst[publicKey] = fp;
+    }
+}
+
 void Settings::removeFriendSettings(const ToxId &id)
 {
     QMutexLocker locker{&bigLock};
@@ -247,6 +247,10 @@ public:
     QDate getFriendActivity(const ToxId &id) const;
     void setFriendActivity(const ToxId &id, const QDate &date);
 
+    /// Tox hash of the friend's cached avatar, empty if unknown
+    QByteArray getFriendAvatarHash(const QString& publicKey) const;
+    void setFriendAvatarHash(const QString& publicKey, const QByteArray& hash);
+
     void removeFriendSettings(const ToxId &id);
 
     bool getFauxOfflineMessaging() const;
@@ -398,6 +402,7 @@ private:
         QString note;
         int circleID = -1;
         QDate activity = QDate();
+        QByteArray avatarHash;
     };
 
     struct circleProp
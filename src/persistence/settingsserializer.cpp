@@ -21,6 +21,7 @@
 #include "serialize.h"
 #include "src/nexus.h"
 #include "src/persistence/profile.h"
+#include "src/persistence/passkeycache.h"
 #include "src/core/core.h"
 #include <QFile>
 #include <QDebug>
@@ -274,9 +275,7 @@ void SettingsSerializer::save()
     // Encrypt
     if (!password.isEmpty())
     {
-        Core* core = Nexus::getCore();
-        auto passkey = core->createPasskey(password);
-        data = core->encryptData(data, *passkey);
+        data = Core::encryptData(data, PasskeyCache::getWriteKey(password));
     }
 
     f.write(data);
@@ -303,13 +302,12 @@ void SettingsSerializer::readSerialized()
             return;
         }
 
-        Core* core = Nexus::getCore();
-
-        uint8_t salt[TOX_PASS_SALT_LENGTH];
-        tox_get_salt(reinterpret_cast<uint8_t *>(data.data()), salt);
-        auto passkey = core->createPasskey(password, salt);
+        TOX_PASS_KEY key;
+        if (PasskeyCache::getKeyForData(password, data, key))
+            data = Core::decryptData(data, key);
+        else
+            data.clear();
 
-        data = core->decryptData(data, *passkey);
         if (data.isEmpty())
         {
             qCritical() << "Failed to decrypt the settings file";
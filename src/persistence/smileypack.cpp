@@ -18,6 +18,7 @@
 */
 
 #include "smileypack.h"
+#include "emoticonmatcher.h"
 #include "src/persistence/settings.h"
 #include "src/widget/style.h"
 
@@ -42,6 +43,12 @@ SmileyPack::SmileyPack()
     connect(&Settings::getInstance(), &Settings::smileyPackChanged, this, &SmileyPack::onSmileyPackChanged);
 }
 
+SmileyPack::~SmileyPack()
+{
+    delete matcher.loadAcquire();
+    qDeleteAll(retiredMatchers);
+}
+
 SmileyPack& SmileyPack::getInstance()
 {
     static SmileyPack smileyPack;
@@ -104,6 +111,7 @@ bool SmileyPack::load(const QString& filename)
     QFile xmlFile(filename);
     if (!xmlFile.open(QIODevice::ReadOnly))
     {
+        retiredMatchers << matcher.fetchAndStoreOrdered(new EmoticonMatcher(QStringList()));
         loadingMutex.unlock();
         return false; // cannot open file
     }
@@ -155,6 +163,10 @@ bool SmileyPack::load(const QString& filename)
             emoticons.push_back(emoticonSet);
     }
 
+    // Readers keep using the previous matcher until this one is complete.
+    // Packs are only switched by the user, so keeping the old matchers around costs little
+    retiredMatchers << matcher.fetchAndStoreOrdered(new EmoticonMatcher(filenameTable.keys()));
+
     // success!
     loadingMutex.unlock();
     return true;
@@ -162,27 +174,33 @@ bool SmileyPack::load(const QString& filename)
 
 QString SmileyPack::smileyfied(QString msg)
 {
-    QMutexLocker locker(&loadingMutex);
+    const EmoticonMatcher* currentMatcher = getMatcher();
+    if (!currentMatcher)
+        return msg;
 
-    QRegExp exp("\\S+"); // matches words
-
-    int index = msg.indexOf(exp);
+    QVector<EmoticonMatcher::Match> matches = currentMatcher->match(msg);
+    if (matches.isEmpty())
+        return msg;
 
     // if a word is key of a smiley, replace it by its corresponding image in Rich Text
-    while (index >= 0)
+    QString result;
+    result.reserve(msg.size() + matches.size() * 48);
+    int last = 0;
+    for (const EmoticonMatcher::Match& match : matches)
     {
-        QString key = exp.cap();
-        if (filenameTable.contains(key))
-        {
-            QString imgRichText = getAsRichText(key);
-
-            msg.replace(index, key.length(), imgRichText);
-            index += imgRichText.length() - key.length();
-        }
-        index = msg.indexOf(exp, index + key.length());
+        result.append(msg.midRef(last, match.pos - last));
+        result.append(getAsRichText(msg.mid(match.pos, match.length)));
+        last = match.pos + match.length;
     }
+    result.append(msg.midRef(last));
 
-    return msg;
+    return result;
+}
+
+bool SmileyPack::isEmoticon(const QStringRef& word) const
+{
+    const EmoticonMatcher* currentMatcher = getMatcher();
+    return currentMatcher && currentMatcher->matches(word);
 }
 
 QList<QStringList> SmileyPack::getEmoticons() const
@@ -225,6 +243,17 @@ QIcon SmileyPack::getCachedSmiley(const QString &key)
     return iconCache.value(file);
 }
 
+const EmoticonMatcher* SmileyPack::getMatcher() const
+{
+    const EmoticonMatcher* currentMatcher = matcher.loadAcquire();
+    if (currentMatcher)
+        return currentMatcher;
+
+    // Only the first load can leave us without a matcher, wait for it
+    QMutexLocker locker(&loadingMutex);
+    return matcher.loadAcquire();
+}
+
 void SmileyPack::onSmileyPackChanged()
 {
     loadingMutex.lock();
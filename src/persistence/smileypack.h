@@ -26,12 +26,16 @@
 #include <QStringList>
 #include <QIcon>
 #include <QMutex>
+#include <QAtomicPointer>
+#include <QList>
 
 #define SMILEYPACK_SEARCH_PATHS                                                                                             \
     {                                                                                                                       \
         ":/smileys", "./smileys", "/usr/share/qtox/smileys", "/usr/share/emoticons", "~/.kde4/share/emoticons", "~/.kde/share/emoticons" \
     }
 
+class EmoticonMatcher;
+
 //maps emoticons to smileys
 class SmileyPack : public QObject
 {
@@ -42,6 +46,7 @@ public:
     static bool isValid(const QString& filename);
 
     QString smileyfied(QString msg);
+    bool isEmoticon(const QStringRef& word) const; ///< The word must be HTML-escaped, like smileyfied's input
     QList<QStringList> getEmoticons() const;
     QString getAsRichText(const QString& key);
     QIcon getAsIcon(const QString& key);
@@ -51,18 +56,22 @@ private slots:
 
 private:
     SmileyPack();
+    ~SmileyPack();
     SmileyPack(SmileyPack&) = delete;
     SmileyPack& operator=(const SmileyPack&) = delete;
 
     bool load(const QString& filename); ///< The caller must lock loadingMutex and should run it in a thread
     void cacheSmiley(const QString& name);
     QIcon getCachedSmiley(const QString& key);
+    const EmoticonMatcher* getMatcher() const;
 
     QHash<QString, QString> filenameTable; // matches an emoticon to its corresponding smiley ie. ":)" -> "happy.png"
     QHash<QString, QIcon> iconCache; // representation of a smiley ie. "happy.png" -> data
     QList<QStringList> emoticons; // {{ ":)", ":-)" }, {":(", ...}, ... }
     QString path; // directory containing the cfg and image files
     mutable QMutex loadingMutex;
+    QAtomicPointer<const EmoticonMatcher> matcher; ///< Matches the loaded pack's emoticons, swapped by load
+    QList<const EmoticonMatcher*> retiredMatchers; ///< Kept alive, smileyfied may still be using them
 };
 
 #endif // SMILEYPACK_H
@@ -33,12 +33,19 @@ extern "C" {
 #include "videoframe.h"
 
 CameraSource* CameraSource::instance{nullptr};
+// Enough for a frame being displayed, one being encoded and a few in flight
+const int CameraSource::maxFrameSlots = 8;
+const quint32 CameraSource::allSlotsFree = (1u << CameraSource::maxFrameSlots) - 1;
+// About a quarter of a frame at 30fps
+const unsigned long CameraSource::idleWaitMs = 8;
 
 CameraSource::CameraSource()
-    : deviceName{"none"}, device{nullptr}, mode(VideoMode{0,0,0}),
+    : freeSlots{allSlotsFree}, framesDelivered{0}, framesDropped{0},
+      deviceName{"none"}, device{nullptr}, mode(VideoMode{0,0,0}),
       cctx{nullptr}, cctxOrig{nullptr}, videoStreamIndex{-1},
       _isOpen{false}, streamBlocker{false}, subscriptions{0}
 {
+    frameSlots.resize(maxFrameSlots);
     subscriptions = 0;
     av_register_all();
     avdevice_register_all();
@@ -72,12 +79,12 @@ void CameraSource::open(const QString deviceName)
 
 void CameraSource::open(const QString DeviceName, VideoMode Mode)
 {
-    streamBlocker = true;
+    setStreamBlocked(true);
     QMutexLocker l{&biglock};
 
     if (DeviceName == deviceName && Mode == mode)
     {
-        streamBlocker = false;
+        setStreamBlocked(false);
         return;
     }
 
@@ -91,7 +98,7 @@ void CameraSource::open(const QString DeviceName, VideoMode Mode)
     if (subscriptions && _isOpen)
         openDevice();
 
-    streamBlocker = false;
+    setStreamBlocked(false);
 }
 
 void CameraSource::close()
@@ -106,20 +113,15 @@ bool CameraSource::isOpen()
 
 CameraSource::~CameraSource()
 {
+    // The stream thread holds the biglock while it waits for a frame, make it let go
+    setStreamBlocked(true);
     QMutexLocker l{&biglock};
+    setStreamBlocked(false);
 
     if (!_isOpen)
         return;
 
-    // Free all remaining VideoFrame
-    // Locking must be done precisely this way to avoid races
-    for (int i = 0; i < freelist.size(); i++)
-    {
-        std::shared_ptr<VideoFrame> vframe = freelist[i].lock();
-        if (!vframe)
-            continue;
-        vframe->releaseFrame();
-    }
+    releaseFrameSlots();
 
     if (cctx)
         avcodec_free_context(&cctx);
@@ -138,13 +140,14 @@ CameraSource::~CameraSource()
     l.unlock();
 
     // Synchronize with our stream thread
-    while (streamFuture.isRunning())
-        QThread::yieldCurrentThread();
+    streamFuture.waitForFinished();
 }
 
 bool CameraSource::subscribe()
 {
+    setStreamBlocked(true);
     QMutexLocker l{&biglock};
+    setStreamBlocked(false);
 
     if (!_isOpen)
     {
@@ -172,9 +175,9 @@ bool CameraSource::subscribe()
 
 void CameraSource::unsubscribe()
 {
-    streamBlocker = true;
+    setStreamBlocked(true);
     QMutexLocker l{&biglock};
-    streamBlocker = false;
+    setStreamBlocked(false);
 
     if (!_isOpen)
     {
@@ -194,8 +197,7 @@ void CameraSource::unsubscribe()
         l.unlock();
 
         // Synchronize with our stream thread
-        while (streamFuture.isRunning())
-            QThread::yieldCurrentThread();
+        streamFuture.waitForFinished();
     }
     else
     {
@@ -279,19 +281,10 @@ bool CameraSource::openDevice()
 
 void CameraSource::closeDevice()
 {
-    qDebug() << "Closing device "<<deviceName;
+    qDebug() << "Closing device "<<deviceName<<", delivered"<<framesDelivered.load()
+             <<"frames and dropped"<<framesDropped.load();
 
-    // Free all remaining VideoFrame
-    // Locking must be done precisely this way to avoid races
-    for (int i = 0; i < freelist.size(); i++)
-    {
-        std::shared_ptr<VideoFrame> vframe = freelist[i].lock();
-        if (!vframe)
-            continue;
-        vframe->releaseFrame();
-    }
-    freelist.clear();
-    freelist.squeeze();
+    releaseFrameSlots();
 
     // Free our resources and close the device
     videoStreamIndex = -1;
@@ -308,36 +301,35 @@ void CameraSource::stream()
 {
     auto streamLoop = [=]()
     {
-        AVFrame* frame = av_frame_alloc();
-        if (!frame)
-            return;
-        frame->opaque = nullptr;
-
         AVPacket packet;
         if (av_read_frame(device->context, &packet)<0)
+        {
+            // Some devices don't block until the next frame is captured, wait a bit
+            // instead of spinning on them. This lets go of the biglock meanwhile.
+            streamIdle.wait(&biglock, idleWaitMs);
             return;
+        }
 
         // Only keep packets from the right stream;
         if (packet.stream_index==videoStreamIndex)
         {
-            // Decode video frame
-            int frameFinished;
-            avcodec_decode_video2(cctx, frame, &frameFinished, &packet);
-            if (!frameFinished)
-                return;
-
-            freelistLock.lock();
-
-            int freeFreelistSlot = getFreelistSlotLockless();
-            auto frameFreeCb = std::bind(&CameraSource::freelistCallback, this, freeFreelistSlot);
-            std::shared_ptr<VideoFrame> vframe = std::make_shared<VideoFrame>(frame, frameFreeCb);
-            freelist.append(vframe);
-            freelistLock.unlock();
-            emit frameAvailable(vframe);
+            AVFrame* frame = av_frame_alloc();
+            if (frame)
+            {
+                frame->opaque = nullptr;
+
+                // Decode video frame
+                int frameFinished = 0;
+                avcodec_decode_video2(cctx, frame, &frameFinished, &packet);
+                if (frameFinished)
+                    deliverFrame(frame);
+                else
+                    av_frame_free(&frame);
+            }
         }
 
-      // Free the packet that was allocated by av_read_frame
-      av_free_packet(&packet);
+        // Free the packet that was allocated by av_read_frame
+        av_free_packet(&packet);
     };
 
     forever {
@@ -355,25 +347,79 @@ void CameraSource::stream()
 
         // Give a chance to other functions to pick up the lock if needed
         biglock.unlock();
-        while (streamBlocker)
-            QThread::yieldCurrentThread();
-        QThread::yieldCurrentThread();
+        if (streamBlocker)
+        {
+            QMutexLocker l{&streamBlockerLock};
+            while (streamBlocker)
+                streamUnblocked.wait(&streamBlockerLock);
+        }
     }
 }
 
-void CameraSource::freelistCallback(int freelistIndex)
+void CameraSource::deliverFrame(AVFrame* frame)
 {
-    QMutexLocker l{&freelistLock};
-    freelist[freelistIndex].reset();
+    // Take the lowest free slot, if our subscribers still hold all of them
+    // they can't keep up and the frame is dropped rather than queued
+    quint32 slots = freeSlots.load();
+    int slot;
+    do
+    {
+        if (!slots)
+        {
+            ++framesDropped;
+            av_frame_free(&frame);
+            return;
+        }
+        slot = 0;
+        while (!(slots & (1u << slot)))
+            ++slot;
+    } while (!freeSlots.compare_exchange_weak(slots, slots & ~(1u << slot)));
+
+    auto frameFreeCb = std::bind(&CameraSource::freelistCallback, this, slot);
+    std::shared_ptr<VideoFrame> vframe = std::make_shared<VideoFrame>(frame, frameFreeCb);
+    frameSlots[slot] = vframe;
+    ++framesDelivered;
+    emit frameAvailable(vframe);
+}
+
+void CameraSource::freelistCallback(int slot)
+{
+    // The frame is dying so its weak_ptr already expired, we only need to free the slot
+    freeSlots.fetch_or(1u << slot);
+}
+
+void CameraSource::releaseFrameSlots()
+{
+    // Free all remaining VideoFrame
+    // Locking must be done precisely this way to avoid races
+    for (int i = 0; i < frameSlots.size(); i++)
+    {
+        std::shared_ptr<VideoFrame> vframe = frameSlots[i].lock();
+        if (!vframe)
+            continue;
+        vframe->releaseFrame();
+    }
+    for (std::weak_ptr<VideoFrame>& slot : frameSlots)
+        slot.reset();
+
+    // Released frames won't call us back anymore
+    freeSlots = allSlotsFree;
 }
 
-int CameraSource::getFreelistSlotLockless()
+void CameraSource::setStreamBlocked(bool blocked)
 {
-    int size = freelist.size();
-    for (int i = 0; i < size; ++i)
-        if (freelist[i].expired())
-            return i;
+    QMutexLocker l{&streamBlockerLock};
+    streamBlocker = blocked;
+    if (!blocked)
+        streamUnblocked.wakeAll();
+}
 
-    freelist.resize(size + (size>>1) + 4); // Arbitrary growth strategy, should work well
-    return size;
+quint64 CameraSource::getFramesDelivered() const
+{
+    return framesDelivered;
+}
+
+quint64 CameraSource::getFramesDropped() const
+{
+    return framesDropped;
 }
@@ -24,12 +24,15 @@
 #include <QString>
 #include <QFuture>
 #include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
 #include <atomic>
 #include "src/video/videosource.h"
 #include "src/video/videomode.h"
 
 class CameraDevice;
 struct AVCodecContext;
+struct AVFrame;
 
 /**
  * This class is a wrapper to share a camera's captured video frames
@@ -61,6 +64,11 @@ public:
     virtual bool subscribe() override;
     virtual void unsubscribe() override;
 
+    /// Number of captured frames emitted since the source was created
+    quint64 getFramesDelivered() const;
+    /// Number of captured frames dropped because our subscribers still held every frame slot
+    quint64 getFramesDropped() const;
+
 signals:
     void deviceOpened();
 
@@ -70,33 +78,45 @@ private:
     /// Blocking. Decodes video stream and emits new frames.
     /// Designed to run in its own thread.
     void stream();
+    /// Emits a decoded frame in a free frame slot, or drops it if there is none
+    /// Called by the stream thread only.
+    void deliverFrame(AVFrame* frame);
     /// All VideoFrames must be deleted or released before we can close the device
     /// or the device will forcibly free them, and then ~VideoFrame() will double free.
     /// In theory very careful coding from our users could ensure all VideoFrames
     /// die before unsubscribing, even the ones currently in flight in the metatype system.
     /// But that's just asking for trouble and mysterious crashes, so we'll just
-    /// maintain a freelist and have all VideoFrames tell us when they die so we can forget them.
-    void freelistCallback(int freelistIndex);
-    /// Get the index of a free slot in the freelist
-    /// Callers must hold the freelistLock
-    int getFreelistSlotLockless();
+    /// keep every frame in a slot and have all VideoFrames tell us when they die so we can reuse it.
+    void freelistCallback(int slot);
+    /// Releases the frames still alive and frees all the slots. Callers must own the biglock.
+    void releaseFrameSlots();
+    /// While blocked the stream thread sleeps between frames, so others can take the biglock
+    void setStreamBlocked(bool blocked);
     bool openDevice(); ///< Callers must own the biglock. Actually opens the video device and starts streaming.
     void closeDevice(); ///< Callers must own the biglock. Actually closes the video device and stops streaming.
 
 private:
-    QVector<std::weak_ptr<VideoFrame>> freelist; ///< Frames that need freeing before we can safely close the device
+    QVector<std::weak_ptr<VideoFrame>> frameSlots; ///< Frames that need freeing before we can safely close the device
+    std::atomic<quint32> freeSlots; ///< Bit i is set when frameSlots[i] can be reused
+    std::atomic<quint64> framesDelivered, framesDropped;
     QFuture<void> streamFuture; ///< Future of the streaming thread
     QString deviceName; ///< Short name of the device for CameraDevice's open(QString)
     CameraDevice* device; ///< Non-owning pointer to an open CameraDevice, or nullptr. Not atomic, synced with memfences when becomes null.
     VideoMode mode; ///< What mode we tried to open the device in, all zeros means default mode
     AVCodecContext* cctx, *cctxOrig; ///< Codec context of the camera's selected video stream
     int videoStreamIndex; ///< A camera can have multiple streams, this is the one we're decoding
-    QMutex biglock, freelistLock; ///< True when locked. Faster than mutexes for video decoding.
+    QMutex biglock;
+    QWaitCondition streamIdle; ///< The stream thread waits on it when the device has no frame ready
+    QMutex streamBlockerLock;
+    QWaitCondition streamUnblocked;
     std::atomic_bool _isOpen;
     std::atomic_bool streamBlocker; ///< Holds the streaming thread still when true
     std::atomic_int subscriptions; ///< Remember how many times we subscribed for RAII
 
     static CameraSource* instance;
+    static const int maxFrameSlots; ///< Frames that can be alive at once, at most 32
+    static const quint32 allSlotsFree;
+    static const unsigned long idleWaitMs; ///< How long to wait for a device that has no frame ready
 };
 
 #endif // CAMERA_H
@@ -23,6 +23,7 @@ extern "C" {
 }
 #include "corevideosource.h"
 #include "videoframe.h"
+#include "framebufferpool.h"
 
 CoreVideoSource::CoreVideoSource()
     : subscribers{0}, deleteOnClose{false},
@@ -39,9 +40,7 @@ void CoreVideoSource::pushFrame(const vpx_image_t* vpxframe)
 
     std::shared_ptr<VideoFrame> vframe;
     AVFrame* avframe;
-    uint8_t* buf;
     int width = vpxframe->d_w, height = vpxframe->d_h;
-    int dstStride, srcStride, minStride;
 
     if (subscribers <= 0)
         return;
@@ -49,34 +48,39 @@ void CoreVideoSource::pushFrame(const vpx_image_t* vpxframe)
     avframe = av_frame_alloc();
     if (!avframe)
         return;
-    avframe->width = width;
-    avframe->height = height;
-    avframe->format = AV_PIX_FMT_YUV420P;
 
-    buf = (uint8_t*)av_malloc(avpicture_get_size(AV_PIX_FMT_YUV420P, width, height));
-    if (!buf)
+    // toxav only lends us its planes for the duration of the callback, so this is
+    // the one copy we can't avoid. The buffer comes from a pool and goes back to it
+    // when the last VideoFrame referencing it dies.
+    if (!FrameBufferPool::allocFrame(avframe, AV_PIX_FMT_YUV420P, width, height))
     {
         av_frame_free(&avframe);
         return;
     }
-    avframe->opaque = buf;
 
-    avpicture_fill((AVPicture*)avframe, buf, AV_PIX_FMT_YUV420P, width, height);
-
-    dstStride=avframe->linesize[0], srcStride=vpxframe->stride[0], minStride=std::min(dstStride, srcStride);
-    for (int i=0; i<height; i++)
-        memcpy(avframe->data[0]+dstStride*i, vpxframe->planes[0]+srcStride*i, minStride);
-    dstStride=avframe->linesize[1], srcStride=vpxframe->stride[1], minStride=std::min(dstStride, srcStride);
-    for (int i=0; i<height/2; i++)
-        memcpy(avframe->data[1]+dstStride*i, vpxframe->planes[1]+srcStride*i, minStride);
-    dstStride=avframe->linesize[2], srcStride=vpxframe->stride[2], minStride=std::min(dstStride, srcStride);
-    for (int i=0; i<height/2; i++)
-        memcpy(avframe->data[2]+dstStride*i, vpxframe->planes[2]+srcStride*i, minStride);
+    copyPlane(avframe->data[0], avframe->linesize[0], vpxframe->planes[0], vpxframe->stride[0], width, height);
+    copyPlane(avframe->data[1], avframe->linesize[1], vpxframe->planes[1], vpxframe->stride[1], (width+1)/2, (height+1)/2);
+    copyPlane(avframe->data[2], avframe->linesize[2], vpxframe->planes[2], vpxframe->stride[2], (width+1)/2, (height+1)/2);
 
     vframe = std::make_shared<VideoFrame>(avframe);
     emit frameAvailable(vframe);
 }
 
+void CoreVideoSource::copyPlane(uint8_t* dst, int dstStride, const uint8_t* src, int srcStride,
+                                int width, int height)
+{
+    int minStride = std::min(std::min(dstStride, srcStride), width);
+    if (dstStride == srcStride && height > 0)
+    {
+        // The last row may not be padded up to the stride
+        memcpy(dst, src, dstStride*(height-1) + minStride);
+        return;
+    }
+
+    for (int i=0; i<height; i++)
+        memcpy(dst+dstStride*i, src+srcStride*i, minStride);
+}
+
 bool CoreVideoSource::subscribe()
 {
     QMutexLocker locker(&biglock);
@@ -42,6 +42,9 @@ private:
 
     /// Makes a copy of the vpx_image_t and emits it as a new VideoFrame
     void pushFrame(const vpx_image_t *frame);
+    /// Copies one plane of a frame, in a single memcpy when the strides allow it
+    static void copyPlane(uint8_t* dst, int dstStride, const uint8_t* src, int srcStride,
+                          int width, int height);
     /// If true, self-delete after the last suscriber is gone
     void setDeleteOnClose(bool newstate);
 
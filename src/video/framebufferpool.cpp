@@ -0,0 +1,86 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+#include <QMutexLocker>
+#include <QDebug>
+#include "framebufferpool.h"
+
+// One per incoming stream size, plus a few display sizes
+const int FrameBufferPool::maxPools = 8;
+QMutex FrameBufferPool::poolsLock;
+QList<QPair<int, AVBufferPool*>> FrameBufferPool::pools;
+
+AVBufferRef* FrameBufferPool::getBuffer(int size)
+{
+    QMutexLocker locker{&poolsLock};
+
+    AVBufferPool* pool = nullptr;
+    for (int i = 0; i < pools.size(); ++i)
+    {
+        if (pools[i].first != size)
+            continue;
+
+        pool = pools[i].second;
+        if (i)
+            pools.move(i, 0);
+        break;
+    }
+
+    if (!pool)
+    {
+        pool = av_buffer_pool_init(size, nullptr);
+        if (!pool)
+            return nullptr;
+
+        if (pools.size() >= maxPools)
+        {
+            // The pool is only freed once all of its buffers are returned
+            AVBufferPool* oldPool = pools.takeLast().second;
+            av_buffer_pool_uninit(&oldPool);
+        }
+        pools.prepend({size, pool});
+    }
+
+    return av_buffer_pool_get(pool);
+}
+
+bool FrameBufferPool::allocFrame(AVFrame* frame, int pixFmt, int width, int height)
+{
+    int size = avpicture_get_size((AVPixelFormat)pixFmt, width, height);
+    if (size <= 0)
+        return false;
+
+    AVBufferRef* buf = getBuffer(size);
+    if (!buf)
+    {
+        qCritical() << "Failed to allocate a frame buffer of" << size << "bytes";
+        return false;
+    }
+
+    avpicture_fill((AVPicture*)frame, buf->data, (AVPixelFormat)pixFmt, width, height);
+    frame->buf[0] = buf;
+    frame->opaque = nullptr;
+    frame->width = width;
+    frame->height = height;
+    frame->format = pixFmt;
+    return true;
+}
@@ -0,0 +1,56 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FRAMEBUFFERPOOL_H
+#define FRAMEBUFFERPOOL_H
+
+#include <QMutex>
+#include <QList>
+#include <QPair>
+
+struct AVFrame;
+struct AVBufferRef;
+struct AVBufferPool;
+
+/// Recycles the pixel buffers of decoded and converted video frames
+/// Frames are allocated and freed many times a second per stream, always with the same
+/// few sizes, so instead of going through av_malloc/av_free each time we keep one
+/// AVBufferPool per buffer size. The frame holds a reference to its buffer in buf[0],
+/// and av_frame_unref/av_frame_free give the buffer back to its pool.
+/// Only the most recently used sizes keep a pool, buffers of evicted pools are freed
+/// once the last frame using them is released.
+/// All methods are thread-safe.
+class FrameBufferPool
+{
+public:
+    /// Sets the format and size of the frame and fills its planes with a pooled buffer
+    /// The frame must not already own a buffer. Returns false if the allocation failed.
+    static bool allocFrame(AVFrame* frame, int pixFmt, int width, int height);
+
+private:
+    FrameBufferPool()=delete;
+    /// Gets a buffer from the pool of this size, creating the pool if necessary
+    static AVBufferRef* getBuffer(int size);
+
+private:
+    static const int maxPools; ///< Number of distinct buffer sizes we keep a pool for
+    static QMutex poolsLock;
+    static QList<QPair<int, AVBufferPool*>> pools; ///< Pools by buffer size, most recently used first
+};
+
+#endif // FRAMEBUFFERPOOL_H
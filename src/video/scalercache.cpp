@@ -0,0 +1,69 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+extern "C" {
+#include <libswscale/swscale.h>
+}
+#include <QMutexLocker>
+#include "scalercache.h"
+
+// A few streams, each displayed at a couple of sizes and maybe encoded
+const int ScalerCache::maxContexts = 16;
+QMutex ScalerCache::cacheLock;
+QList<ScalerCache::Entry> ScalerCache::cache;
+
+bool ScalerCache::Key::operator==(const Key& other) const
+{
+    return srcWidth == other.srcWidth && srcHeight == other.srcHeight && srcFmt == other.srcFmt
+            && dstWidth == other.dstWidth && dstHeight == other.dstHeight && dstFmt == other.dstFmt
+            && flags == other.flags;
+}
+
+SwsContext* ScalerCache::acquire(int srcWidth, int srcHeight, int srcFmt,
+                                 int dstWidth, int dstHeight, int dstFmt, int flags)
+{
+    Key key{srcWidth, srcHeight, srcFmt, dstWidth, dstHeight, dstFmt, flags};
+
+    {
+        QMutexLocker locker{&cacheLock};
+        for (int i = 0; i < cache.size(); ++i)
+            if (cache[i].key == key)
+                return cache.takeAt(i).ctx;
+    }
+
+    return sws_getContext(srcWidth, srcHeight, (AVPixelFormat)srcFmt,
+                          dstWidth, dstHeight, (AVPixelFormat)dstFmt,
+                          flags, nullptr, nullptr, nullptr);
+}
+
+void ScalerCache::release(SwsContext* ctx, int srcWidth, int srcHeight, int srcFmt,
+                          int dstWidth, int dstHeight, int dstFmt, int flags)
+{
+    if (!ctx)
+        return;
+
+    SwsContext* evicted = nullptr;
+    {
+        QMutexLocker locker{&cacheLock};
+        cache.prepend({{srcWidth, srcHeight, srcFmt, dstWidth, dstHeight, dstFmt, flags}, ctx});
+        if (cache.size() > maxContexts)
+            evicted = cache.takeLast().ctx;
+    }
+
+    sws_freeContext(evicted);
+}
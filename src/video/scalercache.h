@@ -0,0 +1,69 @@
+/*
+    Copyright © 2015 by The qTox Project
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SCALERCACHE_H
+#define SCALERCACHE_H
+
+#include <QMutex>
+#include <QList>
+
+struct SwsContext;
+
+/// Keeps swscale contexts alive between conversions
+/// Building a scaler context computes its filters, which costs more than scaling a small frame.
+/// Every frame of a stream converts with the same few parameters, and group calls render
+/// the same streams at several sizes, so contexts are kept by (source format and size,
+/// destination format and size, algorithm) and reused.
+/// Contexts are checked out while in use, so threads never share one and scaling
+/// happens outside the lock. All methods are thread-safe.
+class ScalerCache
+{
+public:
+    /// Takes a context for this conversion out of the cache, or creates one
+    /// Give it back with release once done. Returns nullptr if swscale fails.
+    static SwsContext* acquire(int srcWidth, int srcHeight, int srcFmt,
+                               int dstWidth, int dstHeight, int dstFmt, int flags);
+    /// Returns a context obtained with acquire to the cache
+    static void release(SwsContext* ctx, int srcWidth, int srcHeight, int srcFmt,
+                        int dstWidth, int dstHeight, int dstFmt, int flags);
+
+private:
+    ScalerCache()=delete;
+
+    struct Key
+    {
+        int srcWidth, srcHeight, srcFmt;
+        int dstWidth, dstHeight, dstFmt;
+        int flags;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        SwsContext* ctx;
+    };
+
+private:
+    static const int maxContexts; ///< Contexts kept idle, the least recently used are freed first
+    static QMutex cacheLock;
+    static QList<Entry> cache; ///< Idle contexts, most recently used first
+};
+
+#endif // SCALERCACHE_H
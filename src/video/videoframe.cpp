@@ -26,11 +26,16 @@ extern "C" {
 }
 #include "videoframe.h"
 #include "camerasource.h"
+#include "framebufferpool.h"
+#include "scalercache.h"
+
+// One per view of the same frame in a group call is plenty
+const int VideoFrame::maxScaledFrames = 4;
 
 VideoFrame::VideoFrame(AVFrame* frame, int w, int h, int fmt, std::function<void()> freelistCallback)
     : freelistCallback{freelistCallback},
       frameOther{nullptr}, frameYUV420{nullptr}, frameRGB24{nullptr},
-      width{w}, height{h}, pixFmt{fmt}
+      width{w}, height{h}, pixFmt{fmt}, scaledYUV420{nullptr}
 {
     // Silences pointless swscale warning spam
     // See libswscale/utils.c:1153 @ 74f0bd3
@@ -76,156 +81,159 @@ VideoFrame::~VideoFrame()
 
 QImage VideoFrame::toQImage(QSize size)
 {
-    if (!convertToRGB24(size))
-        return QImage();
-
     QMutexLocker locker(&biglock);
 
-    return QImage(*frameRGB24->data, frameRGB24->width, frameRGB24->height, *frameRGB24->linesize, QImage::Format_RGB888);
+    AVFrame* rgbFrame = convertToRGB24(size);
+    if (!rgbFrame)
+        return QImage();
+
+    return QImage(*rgbFrame->data, rgbFrame->width, rgbFrame->height, *rgbFrame->linesize, QImage::Format_RGB888);
 }
 
-vpx_image *VideoFrame::toVpxImage()
+vpx_image *VideoFrame::toVpxImage(QSize size)
 {
     // libvpx doesn't provide a clean way to reuse an existing external buffer
     // so we'll manually fill-in the vpx_image fields and hope for the best.
     vpx_image* img = new vpx_image;
     memset(img, 0, sizeof(vpx_image));
 
-    if (!convertToYUV420())
+    QMutexLocker locker(&biglock);
+
+    AVFrame* yuvFrame = convertToYUV420(size);
+    if (!yuvFrame)
         return img;
 
-    img->w = img->d_w = width;
-    img->h = img->d_h = height;
+    img->w = img->d_w = yuvFrame->width;
+    img->h = img->d_h = yuvFrame->height;
     img->fmt = VPX_IMG_FMT_I420;
-    img->planes[0] = frameYUV420->data[0];
-    img->planes[1] = frameYUV420->data[1];
-    img->planes[2] = frameYUV420->data[2];
+    img->planes[0] = yuvFrame->data[0];
+    img->planes[1] = yuvFrame->data[1];
+    img->planes[2] = yuvFrame->data[2];
     img->planes[3] = nullptr;
-    img->stride[0] = frameYUV420->linesize[0];
-    img->stride[1] = frameYUV420->linesize[1];
-    img->stride[2] = frameYUV420->linesize[2];
-    img->stride[3] = frameYUV420->linesize[3];
+    img->stride[0] = yuvFrame->linesize[0];
+    img->stride[1] = yuvFrame->linesize[1];
+    img->stride[2] = yuvFrame->linesize[2];
+    img->stride[3] = yuvFrame->linesize[3];
     return img;
 }
 
-bool VideoFrame::convertToRGB24(QSize size)
+AVFrame* VideoFrame::convertToRGB24(QSize size)
 {
-    QMutexLocker locker(&biglock);
+    if (size.isEmpty())
+        size = {width, height};
 
-    AVFrame* sourceFrame;
-    if (frameOther)
+    if (frameRGB24 && size == QSize{width, height})
+        return frameRGB24;
+
+    for (int i = 0; i < scaledRGB24.size(); ++i)
     {
-        sourceFrame = frameOther;
+        AVFrame* frame = scaledRGB24[i];
+        if (frame->width != size.width() || frame->height != size.height())
+            continue;
+
+        if (i)
+            scaledRGB24.move(i, 0);
+        return frame;
     }
-    else if (frameYUV420)
+
+    // Bilinear is better for shrinking, bicubic better for upscaling
+    int resizeAlgo = size.width()<=width ? SWS_BILINEAR : SWS_BICUBIC;
+
+    AVFrame* rgbFrame = convertFrame(AV_PIX_FMT_RGB24, size, resizeAlgo);
+    if (!rgbFrame)
+        return nullptr;
+
+    if (size == QSize{width, height})
     {
-        sourceFrame = frameYUV420;
+        frameRGB24 = rgbFrame;
     }
     else
     {
-        qWarning() << "None of the frames are valid! Did someone release us?";
-        return false;
+        scaledRGB24.prepend(rgbFrame);
+        if (scaledRGB24.size() > maxScaledFrames)
+        {
+            // Only the GUI thread asks for scaled frames and it paints them right away,
+            // so no QImage still points into the frame we evict
+            AVFrame* oldFrame = scaledRGB24.takeLast();
+            freeFrame(oldFrame);
+        }
     }
 
+    return rgbFrame;
+}
+
+AVFrame* VideoFrame::convertToYUV420(QSize size)
+{
     if (size.isEmpty())
-    {
-        size.setWidth(sourceFrame->width);
-        size.setHeight(sourceFrame->height);
-    }
+        size = {width, height};
 
-    if (frameRGB24)
+    if (size == QSize{width, height})
     {
-        if (frameRGB24->width == size.width() && frameRGB24->height == size.height())
-            return true;
-
-        av_free(frameRGB24->opaque);
-        av_frame_unref(frameRGB24);
-        av_frame_free(&frameRGB24);
+        if (!frameYUV420)
+            frameYUV420 = convertFrame(AV_PIX_FMT_YUV420P, size, SWS_BILINEAR);
+        return frameYUV420;
     }
 
-    frameRGB24=av_frame_alloc();
-    if (!frameRGB24)
+    if (scaledYUV420)
     {
-        qCritical() << "av_frame_alloc failed";
-        return false;
-    }
+        if (scaledYUV420->width == size.width() && scaledYUV420->height == size.height())
+            return scaledYUV420;
 
-    uint8_t* buf = (uint8_t*)av_malloc(avpicture_get_size(AV_PIX_FMT_RGB24, size.width(), size.height()));
-    if (!buf)
-    {
-        qCritical() << "av_malloc failed";
-        av_frame_free(&frameRGB24);
-        return false;
+        freeFrame(scaledYUV420);
     }
-    frameRGB24->opaque = buf;
-
-    avpicture_fill((AVPicture*)frameRGB24, buf, AV_PIX_FMT_RGB24, size.width(), size.height());
-    frameRGB24->width = size.width();
-    frameRGB24->height = size.height();
 
-    // Bilinear is better for shrinking, bicubic better for upscaling
-    int resizeAlgo = size.width()<=width ? SWS_BILINEAR : SWS_BICUBIC;
-
-    SwsContext *swsCtx =  sws_getContext(width, height, (AVPixelFormat)pixFmt,
-                                          size.width(), size.height(), AV_PIX_FMT_RGB24,
-                                          resizeAlgo, nullptr, nullptr, nullptr);
-    sws_scale(swsCtx, (uint8_t const * const *)sourceFrame->data,
-                sourceFrame->linesize, 0, height,
-                frameRGB24->data, frameRGB24->linesize);
-    sws_freeContext(swsCtx);
-
-    return true;
+    scaledYUV420 = convertFrame(AV_PIX_FMT_YUV420P, size, SWS_BILINEAR);
+    return scaledYUV420;
 }
 
-bool VideoFrame::convertToYUV420()
+AVFrame* VideoFrame::getSourceFrame()
 {
-    QMutexLocker locker(&biglock);
-
-    if (frameYUV420)
-        return true;
-
-    AVFrame* sourceFrame;
     if (frameOther)
-    {
-        sourceFrame = frameOther;
-    }
-    else if (frameRGB24)
-    {
-        sourceFrame = frameRGB24;
-    }
+        return frameOther;
+    else if (pixFmt == AV_PIX_FMT_YUV420P)
+        return frameYUV420;
     else
+        return frameRGB24;
+}
+
+AVFrame* VideoFrame::convertFrame(int dstFmt, QSize size, int resizeAlgo)
+{
+    AVFrame* sourceFrame = getSourceFrame();
+    if (!sourceFrame)
     {
-        qCritical() << "None of the frames are valid! Did someone release us?";
-        return false;
+        qWarning() << "None of the frames are valid! Did someone release us?";
+        return nullptr;
     }
 
-    frameYUV420=av_frame_alloc();
-    if (!frameYUV420)
+    AVFrame* frame = av_frame_alloc();
+    if (!frame)
     {
         qCritical() << "av_frame_alloc failed";
-        return false;
+        return nullptr;
     }
 
-    uint8_t* buf = (uint8_t*)av_malloc(avpicture_get_size(AV_PIX_FMT_RGB24, width, height));
-    if (!buf)
+    if (!FrameBufferPool::allocFrame(frame, dstFmt, size.width(), size.height()))
     {
-        qCritical() << "av_malloc failed";
-        av_frame_free(&frameYUV420);
-        return false;
+        av_frame_free(&frame);
+        return nullptr;
     }
-    frameYUV420->opaque = buf;
 
-    avpicture_fill((AVPicture*)frameYUV420, buf, AV_PIX_FMT_YUV420P, width, height);
+    SwsContext* swsCtx = ScalerCache::acquire(width, height, pixFmt,
+                                              size.width(), size.height(), dstFmt, resizeAlgo);
+    if (!swsCtx)
+    {
+        qCritical() << "Failed to get a scaler context";
+        freeFrame(frame);
+        return nullptr;
+    }
 
-    SwsContext *swsCtx =  sws_getContext(width, height, (AVPixelFormat)pixFmt,
-                                          width, height, AV_PIX_FMT_YUV420P,
-                                          SWS_BILINEAR, nullptr, nullptr, nullptr);
     sws_scale(swsCtx, (uint8_t const * const *)sourceFrame->data,
                 sourceFrame->linesize, 0, height,
-                frameYUV420->data, frameYUV420->linesize);
-    sws_freeContext(swsCtx);
+                frame->data, frame->linesize);
+    ScalerCache::release(swsCtx, width, height, pixFmt,
+                         size.width(), size.height(), dstFmt, resizeAlgo);
 
-    return true;
+    return frame;
 }
 
 void VideoFrame::releaseFrame()
@@ -238,23 +246,25 @@ void VideoFrame::releaseFrame()
 void VideoFrame::releaseFrameLockless()
 {
     if (frameOther)
-    {
-        av_free(frameOther->opaque);
-        av_frame_unref(frameOther);
-        av_frame_free(&frameOther);
-    }
+        freeFrame(frameOther);
     if (frameYUV420)
-    {
-        av_free(frameYUV420->opaque);
-        av_frame_unref(frameYUV420);
-        av_frame_free(&frameYUV420);
-    }
+        freeFrame(frameYUV420);
     if (frameRGB24)
-    {
-        av_free(frameRGB24->opaque);
-        av_frame_unref(frameRGB24);
-        av_frame_free(&frameRGB24);
-    }
+        freeFrame(frameRGB24);
+    if (scaledYUV420)
+        freeFrame(scaledYUV420);
+    for (AVFrame* frame : scaledRGB24)
+        freeFrame(frame);
+    scaledRGB24.clear();
+}
+
+void VideoFrame::freeFrame(AVFrame*& frame)
+{
+    // Pooled buffers are referenced by the frame and returned by av_frame_unref,
+    // buffers we don't own a reference to are kept in opaque
+    av_free(frame->opaque);
+    av_frame_unref(frame);
+    av_frame_free(&frame);
 }
 
 QSize VideoFrame::getSize()
@@ -22,6 +22,7 @@
 
 #include <QMutex>
 #include <QImage>
+#include <QList>
 #include <functional>
 
 struct AVFrame;
@@ -53,12 +54,23 @@ public:
     QImage toQImage(QSize size = QSize());
     /// Converts the VideoFrame to a vpx_image_t that shares our internal video buffer
     /// Free it with operator delete, NOT vpx_img_free
-    vpx_image* toVpxImage();
+    /// The image is scaled down to size if given, for encoders limited by bandwidth.
+    /// Only the last scaled size is kept, so only the encoding thread should ask for one.
+    vpx_image* toVpxImage(QSize size = QSize());
 
 protected:
-    bool convertToRGB24(QSize size = QSize());
-    bool convertToYUV420();
+    /// Returns the frame converted to RGB24 at this size, converting it if it isn't cached yet
+    /// Callers must hold the biglock
+    AVFrame* convertToRGB24(QSize size = QSize());
+    /// Returns the frame converted to YUV420 at this size. Callers must hold the biglock
+    AVFrame* convertToYUV420(QSize size = QSize());
+    /// Returns the frame we were created with, or nullptr if it was released
+    AVFrame* getSourceFrame();
+    /// Scales the source frame into a new frame of the given format and size
+    AVFrame* convertFrame(int dstFmt, QSize size, int resizeAlgo);
     void releaseFrameLockless();
+    /// Frees an AVFrame and gives its buffer back to its owner
+    static void freeFrame(AVFrame*& frame);
 
 private:
     // Disable copy. Use a shared_ptr if you need copies.
@@ -71,6 +83,12 @@ private:
     AVFrame* frameOther, *frameYUV420, *frameRGB24;
     int width, height;
     int pixFmt;
+    /// RGB24 conversions at other sizes than the original, most recently used first
+    /// Each view showing this frame at a different size gets its own entry
+    QList<AVFrame*> scaledRGB24;
+    AVFrame* scaledYUV420; ///< YUV420 conversion at the size last asked by the encoder
+
+    static const int maxScaledFrames; ///< Sizes kept in scaledRGB24 before the oldest is freed
 };
 
 #endif // VIDEOFRAME_H
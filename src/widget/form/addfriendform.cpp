@@ -29,12 +29,11 @@
 #include "src/nexus.h"
 #include "src/core/core.h"
 #include "src/core/cdata.h"
-#include "src/net/toxdns.h"
 #include "src/persistence/settings.h"
 #include "src/widget/gui.h"
 #include "src/widget/translator.h"
 #include "src/widget/contentlayout.h"
-#include "src/net/toxme.h"
+#include "src/net/toxresolver.h"
 #include <QWindow>
 
 AddFriendForm::AddFriendForm()
@@ -109,34 +108,63 @@ void AddFriendForm::onSendTriggered()
 {
     QString id = toxId.text().trimmed();
 
-    if (!ToxId::isToxId(id))
+    if (ToxId::isToxId(id))
     {
-        ToxId toxId = Toxme::lookup(id); // Try Toxme
-        if (toxId.toString().isEmpty())  // If it isn't supported
-        {
-            qDebug() << "Toxme didn't return a ToxID, trying ToxDNS";
-            if (Settings::getInstance().getProxyType() != ProxyType::ptNone)
-            {
-                QMessageBox::StandardButton btn = QMessageBox::warning(main, "qTox", tr("qTox needs to use the Tox DNS, but can't do it through a proxy.\n\
+        requestFriendship(id, id);
+        return;
+    }
+
+    // Tox DNS can't go through a proxy, so only ask about it if Toxme fails
+    bool proxied = Settings::getInstance().getProxyType() != ProxyType::ptNone;
+    sendButton.setEnabled(false);
+    ToxResolver::resolve(id, proxied ? ToxResolver::UseToxme : ToxResolver::UseAny, this, [=](ToxId resolved)
+    {
+        onIdResolved(id, resolved, proxied);
+    });
+}
+
+void AddFriendForm::onIdResolved(const QString& address, const ToxId& id, bool triedToxmeOnly)
+{
+    if (id.toString().isEmpty() && triedToxmeOnly)
+    {
+        qDebug() << "Toxme didn't return a ToxID, trying ToxDNS";
+        QMessageBox::StandardButton btn = QMessageBox::warning(main, "qTox", tr("qTox needs to use the Tox DNS, but can't do it through a proxy.\n\
     Ignore the proxy and connect to the Internet directly?"), QMessageBox::Yes|QMessageBox::No, QMessageBox::No);
-                if (btn != QMessageBox::Yes)
-                    return;
-            }
-            toxId = ToxDNS::resolveToxAddress(id, true); // Use ToxDNS
-            if (toxId.toString().isEmpty())
+        if (btn == QMessageBox::Yes)
+        {
+            ToxResolver::resolve(address, ToxResolver::UseToxDns, this, [=](ToxId resolved)
             {
-                GUI::showWarning(tr("Couldn't add friend"), tr("This Tox ID does not exist","DNS error"));
-                return;
-            }
+                onIdResolved(address, resolved, false);
+            });
+            return;
         }
-        id = toxId.toString();
+
+        onIdChanged(toxId.text());
+        return;
+    }
+
+    onIdChanged(toxId.text());
+
+    if (id.toString().isEmpty())
+    {
+        GUI::showWarning(tr("Couldn't add friend"), tr("This Tox ID does not exist","DNS error"));
+        return;
     }
 
+    requestFriendship(address, id.toString());
+}
+
+void AddFriendForm::requestFriendship(const QString& address, const QString& id)
+{
     if (id.toUpper() == Core::getInstance()->getSelfId().toString().toUpper())
         GUI::showWarning(tr("Couldn't add friend"), tr("You can't add yourself as a friend!","When trying to add your own Tox ID as friend"));
     else
         emit friendRequested(id, getMessage());
 
+    // The user may have started typing another ID while we were resolving this one
+    if (toxId.text().trimmed() != address)
+        return;
+
     this->toxId.clear();
     this->message.clear();
 }
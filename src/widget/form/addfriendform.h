@@ -25,6 +25,7 @@
 #include <QLineEdit>
 #include <QTextEdit>
 #include <QPushButton>
+#include "src/core/toxid.h"
 
 class ContentLayout;
 
@@ -53,6 +54,9 @@ private slots:
 
 private:
     void retranslateUi();
+    /// Called once address was resolved, id is empty on failure
+    void onIdResolved(const QString& address, const ToxId& id, bool triedToxmeOnly);
+    void requestFriendship(const QString& address, const QString& id);
 
 private:
     void setIdFromClipboard();
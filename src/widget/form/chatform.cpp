@@ -111,6 +111,16 @@ ChatForm::ChatForm(Friend* chatFriend)
     connect(msgEdit, &ChatTextEdit::textChanged, this, &ChatForm::onTextEditChanged);
     connect(core, &Core::fileSendFailed, this, &ChatForm::onFileSendFailed);
     connect(this, &ChatForm::chatAreaCleared, getOfflineMsgEngine(), &OfflineMsgEngine::removeAllReceipts);
+    connect(this, &ChatForm::chatAreaCleared, this, [=]
+    {
+        historyLoading = false;
+        historyExhausted = false;
+        historyTarget = QDateTime();
+        earliestMessageId = 0;
+        ++historyRequest;
+    });
+    connect(this, &ChatForm::historyPageFetched, this, &ChatForm::onHistoryPageFetched, Qt::QueuedConnection);
+    connect(chatWidget, &ChatLog::scrolledNearTop, this, [=]{ loadHistoryPage(); });
     connect(&typingTimer, &QTimer::timeout, this, [=]{
         Core::getInstance()->sendTyping(f->getFriendID(), false);
         isTyping = false;
@@ -130,6 +140,12 @@ ChatForm::ChatForm(Friend* chatFriend)
 ChatForm::~ChatForm()
 {
     Translator::unregister(this);
+
+    // Don't let the database thread deliver a history page to us while we're being deleted
+    Profile* profile = Nexus::getProfile();
+    if (historyPagesInFlight && profile && profile->isHistoryEnabled())
+        profile->getHistory()->sync();
+
     delete netcam;
     delete callConfirm;
     delete offlineEngine;
@@ -676,44 +692,100 @@ void ChatForm::onAvatarRemoved(uint32_t FriendId)
     avatar->setPixmap(QPixmap(":/img/contact_dark.svg"));
 }
 
-void ChatForm::loadHistory(QDateTime since, bool processUndelivered)
+void ChatForm::loadLatestHistory()
 {
-    QDateTime now = historyBaselineDate.addMSecs(-1);
+    Profile* profile = Nexus::getProfile();
+    if (!profile->isHistoryEnabled() || !earliestMessage.isNull() || historyExhausted || historyLoading)
+        return;
+
+    // This first page is small, so we load it right away for the contact list to know our latest message
+    auto msgs = profile->getHistory()->getChatHistoryPage(f->getToxId().publicKey, historyBaselineDate, 0,
+                                                          historyPageSize);
+    insertHistoryPage(msgs);
+}
 
-    if (since > now)
+void ChatForm::loadHistory(QDateTime since)
+{
+    if (since >= historyBaselineDate)
         return;
 
-    if (!earliestMessage.isNull())
+    if (!historyTarget.isValid() || since < historyTarget)
+        historyTarget = since;
+
+    if (!earliestMessage.isNull() && earliestMessage <= historyTarget)
     {
-        if (earliestMessage < since)
-            return;
+        historyTarget = QDateTime();
+        return;
+    }
 
-        if (earliestMessage < now)
-        {
-            now = earliestMessage;
-            now = now.addMSecs(-1);
-        }
+    loadHistoryPage();
+}
+
+void ChatForm::loadHistoryPage()
+{
+    Profile* profile = Nexus::getProfile();
+    if (!profile->isHistoryEnabled() || historyLoading || historyExhausted)
+        return;
+
+    // Keyset pagination: the next page is made of the messages preceding the oldest one we show
+    QDateTime before = earliestMessage.isNull() ? historyBaselineDate : earliestMessage;
+    qint64 beforeId = earliestMessage.isNull() ? 0 : earliestMessageId;
+
+    historyLoading = true;
+    ++historyPagesInFlight;
+    int request = historyRequest;
+    profile->getHistory()->fetchChatHistoryPage(f->getToxId().publicKey, before, beforeId, historyPageSize,
+                                                [this, request](QList<History::HistMessage> msgs)
+    {
+        // We're on the database thread here, the signal is queued to the GUI thread
+        emit historyPageFetched(msgs, request);
+    });
+}
+
+void ChatForm::onHistoryPageFetched(QList<History::HistMessage> msgs, int request)
+{
+    --historyPagesInFlight;
+
+    // The chat was cleared since we asked for this page
+    if (request != historyRequest)
+        return;
+
+    historyLoading = false;
+    insertHistoryPage(msgs);
+
+    if (historyTarget.isValid())
+    {
+        if (!historyExhausted && earliestMessage > historyTarget)
+            loadHistoryPage();
+        else
+            historyTarget = QDateTime();
     }
+}
+
+void ChatForm::insertHistoryPage(const QList<History::HistMessage>& msgs)
+{
+    if (msgs.size() < historyPageSize)
+        historyExhausted = true;
 
-    auto msgs = Nexus::getProfile()->getHistory()->getChatHistory(f->getToxId().publicKey, since, now);
+    // Date of the oldest message we were showing before this page
+    QDate topDate = earliestMessage.isNull() ? QDate() : earliestMessage.toLocalTime().date();
 
     ToxId storedPrevId = previousId;
     ToxId prevId;
 
     QList<ChatLine::Ptr> historyMessages;
 
-    QDate lastDate(1,0,0);
+    // Show the date every new day. The first message of a page only gets one if there is nothing older,
+    // since the previous page could end on the same day
+    QDate lastDate;
     for (const auto &it : msgs)
     {
-        // Show the date every new day
         QDateTime msgDateTime = it.timestamp.toLocalTime();
         QDate msgDate = msgDateTime.date();
 
-        if (msgDate > lastDate)
-        {
-            lastDate = msgDate;
+        if (lastDate.isValid() ? msgDate != lastDate : historyExhausted)
             historyMessages.append(ChatMessage::createChatInfoMessage(msgDate.toString(Settings::getInstance().getDateFormat()), ChatMessage::INFO, QDateTime()));
-        }
+        lastDate = msgDate;
 
         // Show each messages
         ToxId authorId = ToxId(it.sender);
@@ -733,26 +805,38 @@ void ChatForm::loadHistory(QDateTime since, bool processUndelivered)
         prevId = authorId;
         prevMsgDateTime = msgDateTime;
 
-        if (needSending)
+        // Every page may hold some, but a page shown again after a clear must not send them twice
+        if (needSending && !resentHistoryIds.contains(it.id))
         {
-            if (processUndelivered)
-            {
-                int rec;
-                if (!isAction)
-                    rec = Core::getInstance()->sendMessage(f->getFriendID(), msg->toString());
-                else
-                    rec = Core::getInstance()->sendAction(f->getFriendID(), msg->toString());
+            resentHistoryIds.insert(it.id);
 
-                getOfflineMsgEngine()->registerReceipt(rec, it.id, msg);
-            }
+            int rec;
+            if (!isAction)
+                rec = Core::getInstance()->sendMessage(f->getFriendID(), msg->toString());
+            else
+                rec = Core::getInstance()->sendAction(f->getFriendID(), msg->toString());
+
+            getOfflineMsgEngine()->registerReceipt(rec, it.id, msg);
         }
         historyMessages.append(msg);
     }
 
+    // The oldest message we were showing starts a new day, or is the very first one
+    if (topDate.isValid() && (lastDate.isValid() ? lastDate != topDate : historyExhausted))
+        historyMessages.append(ChatMessage::createChatInfoMessage(topDate.toString(Settings::getInstance().getDateFormat()), ChatMessage::INFO, QDateTime()));
+
     previousId = storedPrevId;
-    int savedSliderPos = chatWidget->verticalScrollBar()->maximum() - chatWidget->verticalScrollBar()->value();
 
-    earliestMessage = since;
+    if (historyMessages.isEmpty())
+        return;
+
+    if (!msgs.isEmpty())
+    {
+        earliestMessage = msgs.first().timestamp;
+        earliestMessageId = msgs.first().id;
+    }
+
+    int savedSliderPos = chatWidget->verticalScrollBar()->maximum() - chatWidget->verticalScrollBar()->value();
 
     chatWidget->insertChatlineOnTop(historyMessages);
 
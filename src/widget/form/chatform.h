@@ -22,6 +22,7 @@
 
 #include "genericchatform.h"
 #include "src/core/corestructs.h"
+#include "src/persistence/history.h"
 #include <QSet>
 #include <QLabel>
 #include <QTimer>
@@ -43,7 +44,12 @@ public:
     ChatForm(Friend* chatFriend);
     ~ChatForm();
     void setStatusMessage(QString newMessage);
-    void loadHistory(QDateTime since, bool processUndelivered = false);
+    /// Loads the newest page of history if nothing was loaded yet, and sends its undelivered messages
+    void loadLatestHistory();
+    /// Asynchronously loads pages of history until the given date is reached
+    void loadHistory(QDateTime since);
+    /// Asynchronously loads the page of history preceding the oldest message shown
+    void loadHistoryPage();
 
     void dischargeReceipt(int receipt);
     void setFriendTyping(bool isTyping);
@@ -54,6 +60,7 @@ public:
 signals:
     void sendFile(uint32_t friendId, QString, QString, long long);
     void aliasChanged(const QString& alias);
+    void historyPageFetched(QList<History::HistMessage> msgs, int request);
 
 public slots:
     void startFileSend(ToxFile file);
@@ -84,10 +91,13 @@ private slots:
     void onScreenshotTaken(const QPixmap &pixmap);
     void doScreenshot();
     void onMessageInserted();
+    void onHistoryPageFetched(QList<History::HistMessage> msgs, int request);
 
 private:
     void retranslateUi();
     void showOutgoingCall(bool video);
+    /// Shows a page of history, and sends its undelivered messages again
+    void insertHistoryPage(const QList<History::HistMessage>& msgs);
 
 protected:
     virtual GenericNetCamView* createNetcam() final override;
@@ -109,6 +119,16 @@ private:
     OfflineMsgEngine *offlineEngine;
     QAction* loadHistoryAction;
 
+    // history paging
+    const int historyPageSize = 100;
+    bool historyLoading = false;
+    bool historyExhausted = false;
+    QSet<qint64> resentHistoryIds; ///< Undelivered messages of the history we sent again, a clear doesn't reset it
+    int historyRequest = 0; ///< Incremented when the chat is cleared, to drop the pages requested before
+    int historyPagesInFlight = 0; ///< Pages requested but not delivered yet, clearing the chat doesn't reset it
+    qint64 earliestMessageId = 0;
+    QDateTime historyTarget; ///< Pages are loaded until reaching this date, if valid
+
     QHash<uint, FileTransferInstance*> ftransWidgets;
     void startCounter();
     void stopCounter();
@@ -73,7 +73,6 @@ GenericChatForm::GenericChatForm(QWidget *parent)
     QGridLayout *buttonsLayout = new QGridLayout();
 
     chatWidget = new ChatLog(this);
-    chatWidget->setBusyNotification(ChatMessage::createBusyNotification());
 
     connect(&Settings::getInstance(), &Settings::emojiFontChanged,
             this, [this]() { chatWidget->forceRelayout(); });
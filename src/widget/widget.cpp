@@ -126,6 +126,8 @@ void Widget::init()
     timer->start(1000);
     offlineMsgTimer = new QTimer();
     offlineMsgTimer->start(15000);
+    chatFormPrefetchTimer = new QTimer();
+    chatFormPrefetchTimer->setSingleShot(true);
 
     icon_size = 15;
     statusOnline = new QAction(this);
@@ -256,6 +258,7 @@ void Widget::init()
     connect(timer, &QTimer::timeout, this, &Widget::onEventIconTick);
     connect(timer, &QTimer::timeout, this, &Widget::onTryCreateTrayIcon);
     connect(offlineMsgTimer, &QTimer::timeout, this, &Widget::processOfflineMsgs);
+    connect(chatFormPrefetchTimer, &QTimer::timeout, this, &Widget::prefetchChatForm);
     connect(ui->searchContactText, &QLineEdit::textChanged, this, &Widget::searchContacts);
     connect(filterGroup, &QActionGroup::triggered, this, &Widget::searchContacts);
     connect(filterDisplayGroup, &QActionGroup::triggered, this, &Widget::changeDisplayMode);
@@ -473,6 +476,7 @@ Widget::~Widget()
     delete filesForm;
     delete timer;
     delete offlineMsgTimer;
+    delete chatFormPrefetchTimer;
     delete contentLayout;
 
     FriendList::clear();
@@ -870,7 +874,8 @@ void Widget::setStatusMessage(const QString &statusMessage)
 void Widget::reloadHistory()
 {
     for (auto f : FriendList::getAllFriends())
-        f->getChatForm()->loadHistory(QDateTime::currentDateTime().addDays(-7), true);
+        if (f->hasChatForm())
+            f->getChatForm()->loadLatestHistory();
 }
 
 void Widget::addFriend(int friendId, const QString &userId)
@@ -878,8 +883,17 @@ void Widget::addFriend(int friendId, const QString &userId)
     ToxId userToxId = ToxId(userId);
     Friend* newfriend = FriendList::addFriend(friendId, userToxId);
 
+    // Friends are added one by one, but the summaries of all the chats come from a single query
+    Profile* profile = Nexus::getProfile();
+    if (!chatSummariesLoaded && profile->isHistoryEnabled())
+    {
+        chatSummaries = profile->getHistory()->getChatSummaries();
+        chatSummariesLoaded = true;
+    }
+    History::ChatSummary summary = chatSummaries.value(userToxId.publicKey);
+
     QDate activityDate = Settings::getInstance().getFriendActivity(newfriend->getToxId());
-    QDate chatDate = newfriend->getChatForm()->getLatestDate();
+    QDate chatDate = summary.latest.toLocalTime().date();
 
     if (chatDate > activityDate && chatDate.isValid())
         Settings::getInstance().setFriendActivity(newfriend->getToxId(), chatDate);
@@ -889,35 +903,122 @@ void Widget::addFriend(int friendId, const QString &userId)
     Core* core = Nexus::getCore();
     CoreAV* coreav = core->getAv();
     connect(newfriend, &Friend::displayedNameChanged, this, &Widget::onFriendDisplayChanged);
+    connect(newfriend, &Friend::chatFormCreated, this, &Widget::onChatFormCreated);
     connect(settingsWidget, &SettingsWidget::compactToggled, newfriend->getFriendWidget(), &GenericChatroomWidget::compactChange);
     connect(newfriend->getFriendWidget(), SIGNAL(chatroomWidgetClicked(GenericChatroomWidget*, bool)), this, SLOT(onChatroomWidgetClicked(GenericChatroomWidget*, bool)));
     connect(newfriend->getFriendWidget(), SIGNAL(removeFriend(int)), this, SLOT(removeFriend(int)));
     connect(newfriend->getFriendWidget(), SIGNAL(copyFriendIdToClipboard(int)), this, SLOT(copyFriendIdToClipboard(int)));
-    connect(newfriend->getFriendWidget(), SIGNAL(chatroomWidgetClicked(GenericChatroomWidget*)), newfriend->getChatForm(), SLOT(focusInput()));
-    connect(newfriend->getChatForm(), &GenericChatForm::sendMessage, core, &Core::sendMessage);
-    connect(newfriend->getChatForm(), &GenericChatForm::sendAction, core, &Core::sendAction);
-    connect(newfriend->getChatForm(), &ChatForm::sendFile, core, &Core::sendFile);
-    connect(newfriend->getChatForm(), &ChatForm::aliasChanged, newfriend->getFriendWidget(), &FriendWidget::setAlias);
-    connect(core, &Core::fileReceiveRequested, newfriend->getChatForm(), &ChatForm::onFileRecvRequest);
-    connect(coreav, &CoreAV::avInvite, newfriend->getChatForm(), &ChatForm::onAvInvite, Qt::BlockingQueuedConnection);
-    connect(coreav, &CoreAV::avStart, newfriend->getChatForm(), &ChatForm::onAvStart, Qt::BlockingQueuedConnection);
-    connect(coreav, &CoreAV::avEnd, newfriend->getChatForm(), &ChatForm::onAvEnd, Qt::BlockingQueuedConnection);
-    connect(core, &Core::friendAvatarChanged, newfriend->getChatForm(), &ChatForm::onAvatarChange);
     connect(core, &Core::friendAvatarChanged, newfriend->getFriendWidget(), &FriendWidget::onAvatarChange);
-    connect(core, &Core::friendAvatarRemoved, newfriend->getChatForm(), &ChatForm::onAvatarRemoved);
     connect(core, &Core::friendAvatarRemoved, newfriend->getFriendWidget(), &FriendWidget::onAvatarRemoved);
 
-    // Try to get the avatar from the cache
-    QPixmap avatar = Nexus::getProfile()->loadAvatar(userId);
-    if (!avatar.isNull())
+    // Calls must reach friends whose chat form doesn't exist yet, CoreAV is recreated with the Core
+    auto uniqueBlocking = static_cast<Qt::ConnectionType>(Qt::BlockingQueuedConnection | Qt::UniqueConnection);
+    connect(coreav, &CoreAV::avInvite, this, &Widget::onFriendAvInvite, uniqueBlocking);
+    connect(coreav, &CoreAV::avStart, this, &Widget::onFriendAvStart, uniqueBlocking);
+    connect(coreav, &CoreAV::avEnd, this, &Widget::onFriendAvEnd, uniqueBlocking);
+
+    // Try to get the avatar from the cache, decrypting it off the GUI thread
+    FriendWidget* friendWidget = newfriend->getFriendWidget();
+    Nexus::getProfile()->loadAvatarAsync(userId, friendWidget, [=](QPixmap avatar)
     {
-        newfriend->getChatForm()->onAvatarChange(friendId, avatar);
-        newfriend->getFriendWidget()->onAvatarChange(friendId, avatar);
-    }
+        if (!avatar.isNull())
+            friendWidget->onAvatarChange(friendId, avatar);
+    });
 
     int filter = getFilterCriteria();
     newfriend->getFriendWidget()->search(ui->searchContactText->text(), filterOffline(filter));
 
+    // Undelivered messages are resent from the chat form, so it's needed right away
+    if (summary.unsent)
+        newfriend->getChatForm();
+    else if (summary.latest.isValid())
+        queueChatFormPrefetch(friendId, summary.latest);
+}
+
+void Widget::onChatFormCreated(Friend* f)
+{
+    Core* core = Nexus::getCore();
+    ChatForm* chatForm = f->getChatForm();
+    connect(f->getFriendWidget(), SIGNAL(chatroomWidgetClicked(GenericChatroomWidget*)), chatForm, SLOT(focusInput()));
+    connect(chatForm, &GenericChatForm::sendMessage, core, &Core::sendMessage);
+    connect(chatForm, &GenericChatForm::sendAction, core, &Core::sendAction);
+    connect(chatForm, &ChatForm::sendFile, core, &Core::sendFile);
+    connect(chatForm, &ChatForm::aliasChanged, f->getFriendWidget(), &FriendWidget::setAlias);
+    connect(core, &Core::friendAvatarChanged, chatForm, &ChatForm::onAvatarChange);
+    connect(core, &Core::friendAvatarRemoved, chatForm, &ChatForm::onAvatarRemoved);
+
+    // The avatar decoded for the contact list is usually cached by now, otherwise it's decrypted off the GUI thread
+    int friendId = f->getFriendID();
+    Nexus::getProfile()->loadAvatarAsync(f->getToxId().publicKey, chatForm, [=](QPixmap avatar)
+    {
+        if (!avatar.isNull())
+            chatForm->onAvatarChange(friendId, avatar);
+    });
+}
+
+void Widget::queueChatFormPrefetch(int friendId, const QDateTime& latest)
+{
+    // Keep the most recent chats, they're the ones likely to be opened
+    auto it = chatFormPrefetch.begin();
+    while (it != chatFormPrefetch.end() && it->first >= latest)
+        ++it;
+    chatFormPrefetch.insert(it, {latest, friendId});
+    if (chatFormPrefetch.size() > maxPrefetchedChatForms)
+        chatFormPrefetch.removeLast();
+
+    // Restarted on every friend, so the prefetch only starts once the contact list is loaded
+    chatFormPrefetchTimer->start(chatFormPrefetchDelay);
+}
+
+void Widget::prefetchChatForm()
+{
+    while (!chatFormPrefetch.isEmpty())
+    {
+        Friend* f = FriendList::findFriend(chatFormPrefetch.takeFirst().second);
+        if (!f || f->hasChatForm())
+            continue;
+
+        f->getChatForm();
+        // One form per tick, the GUI stays responsive while we build them
+        chatFormPrefetchTimer->start(chatFormPrefetchInterval);
+        return;
+    }
+}
+
+void Widget::onFileReceiveRequested(const ToxFile& file)
+{
+    Friend* f = FriendList::findFriend(file.friendId);
+    if (!f)
+        return;
+
+    f->getChatForm()->onFileRecvRequest(file);
+}
+
+void Widget::onFriendAvInvite(uint32_t friendId, bool video)
+{
+    Friend* f = FriendList::findFriend(friendId);
+    if (!f)
+        return;
+
+    f->getChatForm()->onAvInvite(friendId, video);
+}
+
+void Widget::onFriendAvStart(uint32_t friendId, bool video)
+{
+    Friend* f = FriendList::findFriend(friendId);
+    if (!f)
+        return;
+
+    f->getChatForm()->onAvStart(friendId, video);
+}
+
+void Widget::onFriendAvEnd(uint32_t friendId)
+{
+    Friend* f = FriendList::findFriend(friendId);
+    if (!f || !f->hasChatForm())
+        return;
+
+    f->getChatForm()->onAvEnd(friendId);
 }
 
 void Widget::addFriendFailed(const QString&, const QString& errorInfo)
@@ -960,7 +1061,7 @@ void Widget::onFriendStatusChanged(int friendId, Status status)
     ContentDialog::updateFriendStatus(friendId);
 
     //won't print the message if there were no messages before
-    if (!f->getChatForm()->isEmpty()
+    if (f->hasChatForm() && !f->getChatForm()->isEmpty()
             && Settings::getInstance().getStatusChangeNotificationEnabled())
     {
         QString fStatus = "";
@@ -982,7 +1083,7 @@ void Widget::onFriendStatusChanged(int friendId, Status status)
                                                    ChatMessage::INFO, QDateTime::currentDateTime());
     }
 
-    if (isActualChange && status != Status::Offline)
+    if (isActualChange && status != Status::Offline && f->hasChatForm())
     { // wait a little
         QTimer::singleShot(250, f->getChatForm()->getOfflineMsgEngine(), SLOT(deliverOfflineMsgs()));
     }
@@ -1089,7 +1190,7 @@ void Widget::onFriendMessageReceived(int friendId, const QString& message, bool
 void Widget::onReceiptRecieved(int friendId, int receipt)
 {
     Friend* f = FriendList::findFriend(friendId);
-    if (!f)
+    if (!f || !f->hasChatForm())
         return;
 
     f->getChatForm()->getOfflineMsgEngine()->dischargeReceipt(receipt);
@@ -1323,6 +1424,11 @@ void Widget::clearContactsList()
     QList<Group*> groups = GroupList::getAllGroups();
     for (Group* g : groups)
         removeGroup(g, true);
+
+    chatSummaries.clear();
+    chatSummariesLoaded = false;
+    chatFormPrefetch.clear();
+    chatFormPrefetchTimer->stop();
 }
 
 ContentDialog* Widget::createContentDialog() const
@@ -1755,7 +1861,7 @@ void Widget::onGroupSendResult(int groupId, const QString& message, int result)
 void Widget::onFriendTypingChanged(int friendId, bool isTyping)
 {
     Friend* f = FriendList::findFriend(friendId);
-    if (!f)
+    if (!f || !f->hasChatForm())
         return;
 
     f->getChatForm()->setFriendTyping(isTyping);
@@ -1832,7 +1938,8 @@ void Widget::processOfflineMsgs()
     {
         QList<Friend*> frnds = FriendList::getAllFriends();
         for (Friend *f : frnds)
-            f->getChatForm()->getOfflineMsgEngine()->deliverOfflineMsgs();
+            if (f->hasChatForm())
+                f->getChatForm()->getOfflineMsgEngine()->deliverOfflineMsgs();
 
         OfflineMsgEngine::globalMutex.unlock();
     }
@@ -1842,7 +1949,8 @@ void Widget::clearAllReceipts()
 {
     QList<Friend*> frnds = FriendList::getAllFriends();
     for (Friend *f : frnds)
-        f->getChatForm()->getOfflineMsgEngine()->removeAllReceipts();
+        if (f->hasChatForm())
+            f->getChatForm()->getOfflineMsgEngine()->removeAllReceipts();
 }
 
 void Widget::reloadTheme()
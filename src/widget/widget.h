@@ -24,6 +24,7 @@
 #include <QSystemTrayIcon>
 #include <QFileInfo>
 #include "src/core/corestructs.h"
+#include "src/persistence/history.h"
 #include "genericchatitemwidget.h"
 
 #define PIXELS_TO_ACT 7
@@ -136,6 +137,10 @@ public slots:
     void onGroupPeerAudioPlaying(int groupnumber, int peernumber);
     void onGroupSendResult(int groupId, const QString& message, int result);
     void onFriendTypingChanged(int friendId, bool isTyping);
+    void onFileReceiveRequested(const ToxFile& file);
+    void onFriendAvInvite(uint32_t friendId, bool video);
+    void onFriendAvStart(uint32_t friendId, bool video);
+    void onFriendAvEnd(uint32_t friendId);
     void nextContact();
     void previousContact();
 
@@ -180,6 +185,8 @@ private slots:
     void onSplitterMoved(int pos, int index);
     void processOfflineMsgs();
     void friendListContextMenu(const QPoint &pos);
+    void onChatFormCreated(Friend* f);
+    void prefetchChatForm(); ///< Creates the next queued chat form, if any
 
 private:
     int icon_size;
@@ -221,6 +228,8 @@ private:
     static bool filterOffline(int index);
     void retranslateUi();
     void focusChatInput();
+    /// Queues the friend's chat form to be created in the background, if the chat is among the most recent
+    void queueChatFormPrefetch(int friendId, const QDateTime& latest);
 
 private:
     SystemTrayIcon *icon;
@@ -258,7 +267,13 @@ private:
     MaskablePixmapWidget *profilePicture;
     bool notify(QObject *receiver, QEvent *event);
     bool autoAwayActive = false;
-    QTimer *timer, *offlineMsgTimer;
+    QTimer *timer, *offlineMsgTimer, *chatFormPrefetchTimer;
+    QHash<QString, History::ChatSummary> chatSummaries; ///< Summary of each chat by public key, for the contact list
+    bool chatSummariesLoaded = false;
+    QList<QPair<QDateTime, int>> chatFormPrefetch; ///< Friend IDs to create the chat form of, most recent chat first
+    static constexpr int maxPrefetchedChatForms = 16;
+    static constexpr int chatFormPrefetchDelay = 2000; ///< Milliseconds without new friends before prefetching
+    static constexpr int chatFormPrefetchInterval = 50; ///< Milliseconds between two prefetched chat forms
     QRegExp nameMention, sanitizedNameMention;
     bool eventFlag;
     bool eventIcon;